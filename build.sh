@@ -5,6 +5,9 @@ ver=0.1.0
 verbose=0
 dist=0
 debug=0
+profile_memory=0
+load_arena=0
+simd=0
 
 for arg in "$@"; do
     if [ "${arg}" == "--verbose" ] || [ "${arg}" == "-v" ]; then
@@ -16,6 +19,15 @@ for arg in "$@"; do
     if [ "${arg}" == "--debug" ] || [ "${arg}" == "-d" ]; then
         debug=1
     fi
+    if [ "${arg}" == "--profile-memory" ]; then
+        profile_memory=1
+    fi
+    if [ "${arg}" == "--load-arena" ]; then
+        load_arena=1
+    fi
+    if [ "${arg}" == "--simd" ]; then
+        simd=1
+    fi
 done
 
 if [ "${verbose}" -eq 1 ]; then
@@ -171,6 +183,23 @@ else
     extra_cmake_flags+=("-DDEBUG_BUILD=OFF")
 fi
 
+if [ "$profile_memory" -eq 1 ]; then
+    extra_cmake_flags+=("-DMEMORY_PROFILING=ON")
+else
+    extra_cmake_flags+=("-DMEMORY_PROFILING=OFF")
+fi
+
+if [ "$load_arena" -eq 1 ]; then
+    extra_cmake_flags+=("-DLOAD_ARENA=ON")
+else
+    extra_cmake_flags+=("-DLOAD_ARENA=OFF")
+fi
+
+if [ "$simd" -eq 1 ]; then
+    extra_cmake_flags+=("-DENABLE_SIMD=ON")
+else
+    extra_cmake_flags+=("-DENABLE_SIMD=OFF")
+fi
 
 if [ "$verbose" -eq 1 ]; then
     extra_cmake_flags+=("-DCMAKE_VERBOSE_MAKEFILE=ON")
@@ -196,8 +225,10 @@ if [ ! -d "${script_dir}/src" ]; then
 fi
 
 html_file="${script_dir}/web/index.html"
+benchmark_file="${script_dir}/web/benchmark.html"
 
 cp "${html_file}" "${build_dir}/staircase/index.html"
+cp "${benchmark_file}" "${build_dir}/staircase/benchmark.html"
 
 if [ "$dist" -eq 1 ]; then
     echo "Creating distribution package..."
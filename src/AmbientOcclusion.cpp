@@ -0,0 +1,410 @@
+#include "AmbientOcclusion.hpp"
+#include "ModelRegistry.hpp"
+#include "OCCTUtilities.hpp"
+#include "PartIndex.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <emscripten.h>
+#include <opencascade/Graphic3d_ShaderAttribute.hxx>
+#include <opencascade/Graphic3d_ShaderObject.hxx>
+#include <opencascade/Graphic3d_Vec3.hxx>
+#include <shared_mutex>
+
+namespace {
+
+// The first bake to finish for a ray count, attached to the model and
+// reused by the viewers that show it.
+struct OcclusionCache {
+  std::mutex mutex;
+  int rays = 0;
+  std::shared_ptr<PartOcclusion const> occlusion;
+};
+
+char const *const VertexShader = R"(
+THE_SHADER_OUT vec3 viewNormal;
+THE_SHADER_OUT float occlusion;
+
+void main() {
+  viewNormal = (occWorldViewMatrix * occModelWorldMatrix * vec4(occNormal, 0.0)).xyz;
+  occlusion = occVertColor.r;
+  gl_Position = occProjectionMatrix * occWorldViewMatrix * occModelWorldMatrix * occVertex;
+}
+)";
+
+char const *const FragmentShader = R"(
+THE_SHADER_IN vec3 viewNormal;
+THE_SHADER_IN float occlusion;
+
+void main() {
+  float light = 0.3 + 0.7 * abs(normalize(viewNormal).z);
+  occSetFragColor(vec4(occColor.rgb * light * mix(0.35, 1.0, occlusion), occColor.a));
+}
+)";
+
+struct Ray {
+  Graphic3d_Vec3 origin;
+  Graphic3d_Vec3 direction;
+  Graphic3d_Vec3 inverse;
+  float near = 0.0f;
+  float far = 0.0f;
+};
+
+// The world-space triangles of a part with a tree over them, and a normal
+// for each of its vertices.
+struct PartMesh {
+  struct Node {
+    Graphic3d_Vec3 lower;
+    Graphic3d_Vec3 upper;
+    // Children for inner nodes; the range of corners / 3 for leaves.
+    int left = -1;
+    int right = -1;
+    int first = 0;
+    int count = 0;
+  };
+
+  static int const LeafSize = 4;
+
+  std::vector<Graphic3d_Vec3> points;
+  std::vector<Graphic3d_Vec3> normals;
+  std::vector<uint32_t> corners; // three per triangle, grouped by leaf
+  std::vector<Node> nodes;
+
+  void build();
+  bool hits(Ray const &ray) const;
+
+private:
+  int build(std::vector<uint32_t> &order, std::vector<Graphic3d_Vec3> const &centers,
+            int first, int count);
+};
+
+PartMesh meshPart(TopoDS_Shape const &shape) {
+  PartMesh mesh;
+  forEachTriangulation(shape, [&mesh](TopoDS_Face const &face,
+                                      Handle(Poly_Triangulation) const &tri,
+                                      TopLoc_Location const &location) {
+    gp_Trsf const trsf = location.Transformation();
+    bool const reversed = face.Orientation() == TopAbs_REVERSED;
+    uint32_t const base = uint32_t(mesh.points.size());
+    for (int n = 1; n <= tri->NbNodes(); ++n) {
+      gp_Pnt const p = tri->Node(n).Transformed(trsf);
+      mesh.points.emplace_back(float(p.X()), float(p.Y()), float(p.Z()));
+    }
+
+    // Normals of the triangles, weighted by their area, rather than the
+    // triangulation's, which computing would modify.
+    mesh.normals.resize(mesh.points.size(), Graphic3d_Vec3(0.0f));
+    for (int t = 1; t <= tri->NbTriangles(); ++t) {
+      int a, b, c;
+      tri->Triangle(t).Get(a, b, c);
+      if (reversed) { std::swap(b, c); }
+      uint32_t const ia = base + a - 1, ib = base + b - 1, ic = base + c - 1;
+      Graphic3d_Vec3 const normal = Graphic3d_Vec3::Cross(
+          mesh.points[ib] - mesh.points[ia], mesh.points[ic] - mesh.points[ia]);
+      for (uint32_t corner : {ia, ib, ic}) { mesh.normals[corner] += normal; }
+      mesh.corners.insert(mesh.corners.end(), {ia, ib, ic});
+    }
+  });
+  for (Graphic3d_Vec3 &normal : mesh.normals) {
+    if (normal.Modulus() > 0.0f) { normal.Normalize(); }
+  }
+  return mesh;
+}
+
+void PartMesh::build() {
+  int const count = int(corners.size() / 3);
+  if (count == 0) { return; }
+  std::vector<uint32_t> order(count);
+  std::vector<Graphic3d_Vec3> centers(count);
+  for (int t = 0; t < count; ++t) {
+    order[t] = uint32_t(t);
+    centers[t] = (points[corners[3 * t]] + points[corners[3 * t + 1]] +
+                  points[corners[3 * t + 2]]) / 3.0f;
+  }
+  nodes.reserve(2 * count / LeafSize + 1);
+  build(order, centers, 0, count);
+
+  std::vector<uint32_t> grouped(corners.size());
+  for (int t = 0; t < count; ++t) {
+    std::copy_n(corners.begin() + 3 * order[t], 3, grouped.begin() + 3 * t);
+  }
+  corners = std::move(grouped);
+}
+
+int PartMesh::build(std::vector<uint32_t> &order,
+                    std::vector<Graphic3d_Vec3> const &centers, int first,
+                    int count) {
+  int const index = int(nodes.size());
+  nodes.emplace_back();
+  Node node;
+  node.lower = node.upper = points[corners[3 * order[first]]];
+  for (int t = first; t < first + count; ++t) {
+    for (int corner = 0; corner < 3; ++corner) {
+      Graphic3d_Vec3 const &p = points[corners[3 * order[t] + corner]];
+      node.lower = node.lower.cwiseMin(p);
+      node.upper = node.upper.cwiseMax(p);
+    }
+  }
+
+  if (count <= LeafSize) {
+    node.first = first;
+    node.count = count;
+    nodes[index] = node;
+    return index;
+  }
+
+  // Splits at the median center along the longest axis.
+  Graphic3d_Vec3 const extent = node.upper - node.lower;
+  int const axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0
+                   : extent.y() >= extent.z()                           ? 1
+                                                                        : 2;
+  int const half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count,
+                   [&centers, axis](uint32_t a, uint32_t b) {
+                     return centers[a][axis] < centers[b][axis];
+                   });
+  node.left = build(order, centers, first, half);
+  node.right = build(order, centers, first + half, count - half);
+  nodes[index] = node;
+  return index;
+}
+
+bool entersBox(Ray const &ray, Graphic3d_Vec3 const &lower,
+               Graphic3d_Vec3 const &upper) {
+  float near = ray.near;
+  float far = ray.far;
+  for (int axis = 0; axis < 3; ++axis) {
+    float t0 = (lower[axis] - ray.origin[axis]) * ray.inverse[axis];
+    float t1 = (upper[axis] - ray.origin[axis]) * ray.inverse[axis];
+    if (t0 > t1) { std::swap(t0, t1); }
+    near = std::max(near, t0);
+    far = std::min(far, t1);
+    if (near > far) { return false; }
+  }
+  return true;
+}
+
+// Whether the ray hits any triangle between its near and far distance, from
+// either side.
+bool PartMesh::hits(Ray const &ray) const {
+  if (nodes.empty()) { return false; }
+  int stack[64];
+  int size = 0;
+  stack[size++] = 0;
+  while (size > 0) {
+    Node const &node = nodes[stack[--size]];
+    if (!entersBox(ray, node.lower, node.upper)) { continue; }
+    if (node.left >= 0) {
+      stack[size++] = node.left;
+      stack[size++] = node.right;
+      continue;
+    }
+    for (int t = node.first; t < node.first + node.count; ++t) {
+      Graphic3d_Vec3 const &a = points[corners[3 * t]];
+      Graphic3d_Vec3 const e1 = points[corners[3 * t + 1]] - a;
+      Graphic3d_Vec3 const e2 = points[corners[3 * t + 2]] - a;
+      Graphic3d_Vec3 const p = Graphic3d_Vec3::Cross(ray.direction, e2);
+      float const det = e1.Dot(p);
+      if (std::abs(det) < 1e-12f) { continue; }
+      float const inverse = 1.0f / det;
+      Graphic3d_Vec3 const s = ray.origin - a;
+      float const u = s.Dot(p) * inverse;
+      if (u < 0.0f || u > 1.0f) { continue; }
+      Graphic3d_Vec3 const q = Graphic3d_Vec3::Cross(s, e1);
+      float const v = ray.direction.Dot(q) * inverse;
+      if (v < 0.0f || u + v > 1.0f) { continue; }
+      float const distance = e2.Dot(q) * inverse;
+      if (distance > ray.near && distance < ray.far) { return true; }
+    }
+  }
+  return false;
+}
+
+// Cosine-weighted directions over the hemisphere around +Z, from a
+// Hammersley set so that few rays still cover it evenly.
+std::vector<Graphic3d_Vec3> hemisphere(int rays) {
+  std::vector<Graphic3d_Vec3> directions(rays);
+  for (int i = 0; i < rays; ++i) {
+    uint32_t bits = uint32_t(i);
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    float const u = (i + 0.5f) / rays;
+    float const phi = float(2.0 * M_PI) * (bits * 2.3283064e-10f);
+    float const r = std::sqrt(u);
+    directions[i] = Graphic3d_Vec3(r * std::cos(phi), r * std::sin(phi),
+                                   std::sqrt(1.0f - u));
+  }
+  return directions;
+}
+
+std::vector<uint8_t> bakePart(std::vector<PartMesh> const &meshes, size_t part,
+                              std::vector<size_t> const &near,
+                              std::vector<Graphic3d_Vec3> const &directions,
+                              float radius) {
+  PartMesh const &mesh = meshes[part];
+  std::vector<uint8_t> occlusion(mesh.points.size(), 255);
+
+  // The part itself first, since it is the likeliest to be hit.
+  std::vector<PartMesh const *> occluders{&mesh};
+  for (size_t other : near) {
+    if (other != part && !meshes[other].nodes.empty()) {
+      occluders.push_back(&meshes[other]);
+    }
+  }
+
+  Ray ray;
+  ray.near = radius * 1e-3f;
+  ray.far = radius;
+  for (size_t v = 0; v < mesh.points.size(); ++v) {
+    Graphic3d_Vec3 const &normal = mesh.normals[v];
+    if (normal.Modulus() == 0.0f) { continue; }
+    Graphic3d_Vec3 const helper = std::abs(normal.x()) > 0.9f
+                                      ? Graphic3d_Vec3(0.0f, 1.0f, 0.0f)
+                                      : Graphic3d_Vec3(1.0f, 0.0f, 0.0f);
+    Graphic3d_Vec3 const tangent = Graphic3d_Vec3::Cross(helper, normal).Normalized();
+    Graphic3d_Vec3 const bitangent = Graphic3d_Vec3::Cross(normal, tangent);
+    ray.origin = mesh.points[v] + normal * ray.near;
+
+    int hits = 0;
+    for (Graphic3d_Vec3 const &d : directions) {
+      ray.direction = tangent * d.x() + bitangent * d.y() + normal * d.z();
+      for (int axis = 0; axis < 3; ++axis) {
+        ray.inverse[axis] = 1.0f / ray.direction[axis];
+      }
+      for (PartMesh const *occluder : occluders) {
+        if (occluder->hits(ray)) {
+          ++hits;
+          break;
+        }
+      }
+    }
+    occlusion[v] = uint8_t(std::lround(255.0 * (directions.size() - hits) /
+                                       directions.size()));
+  }
+  return occlusion;
+}
+
+} // namespace
+
+Handle(Graphic3d_ShaderProgram) const &occlusionShaderProgram() {
+  static Handle(Graphic3d_ShaderProgram) const program = [] {
+    Handle(Graphic3d_ShaderProgram) program = new Graphic3d_ShaderProgram();
+    program->SetId("staircase_occlusion");
+    program->AttachShader(
+        Graphic3d_ShaderObject::CreateFromSource(Graphic3d_TOS_VERTEX, VertexShader));
+    program->AttachShader(
+        Graphic3d_ShaderObject::CreateFromSource(Graphic3d_TOS_FRAGMENT, FragmentShader));
+
+    Graphic3d_ShaderAttributeList attributes;
+    attributes.Append(new Graphic3d_ShaderAttribute("occVertex", Graphic3d_TOA_POS));
+    attributes.Append(new Graphic3d_ShaderAttribute("occNormal", Graphic3d_TOA_NORM));
+    attributes.Append(new Graphic3d_ShaderAttribute("occVertColor", Graphic3d_TOA_COLOR));
+    program->SetVertexAttributes(attributes);
+    return program;
+  }();
+  return program;
+}
+
+OcclusionBaker::OcclusionBaker(std::shared_ptr<LoadedModel> const &model, int rays)
+    : rays(std::max(rays, 1)), inbox(std::make_shared<Inbox>()),
+      cancelled(std::make_shared<std::atomic<bool>>(false)),
+      baked(model->parts.size(), false) {
+  auto work = std::make_shared<PartOcclusion>(model->parts.size());
+  values = work;
+
+  auto inbox = this->inbox;
+  auto cancelled = this->cancelled;
+  int const rayCount = this->rays;
+  WorkerPool::submit([model, inbox, cancelled, work, rayCount]() {
+    TRACE_SCOPE("OcclusionBaker::bake");
+    double const start = emscripten_get_now();
+    OcclusionCache &cache = model->attached<OcclusionCache>();
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      if (cache.rays == rayCount && cache.occlusion) {
+        std::lock_guard<std::mutex> inboxLock(inbox->mutex);
+        inbox->cached = cache.occlusion;
+        inbox->milliseconds = emscripten_get_now() - start;
+        return;
+      }
+    }
+
+    size_t const count = model->parts.size();
+    std::vector<PartMesh> meshes(count);
+    {
+      std::shared_lock<std::shared_mutex> lock(model->triangulationMutex);
+      WorkerPool::parallelFor(count, [&](size_t i) {
+        if (*cancelled) { return; }
+        meshes[i] = meshPart(model->parts[i].shape);
+        meshes[i].build();
+      });
+    }
+
+    PartIndex const &partIndex = model->attached<PartIndex>();
+    Bnd_Box const bounds = partIndex.visibleBox();
+    float const radius =
+        bounds.IsVoid() ? 1.0f
+                        : float(std::sqrt(bounds.SquareExtent()) * RadiusFraction);
+    std::vector<Graphic3d_Vec3> const directions = hemisphere(rayCount);
+
+    for (size_t first = 0; first < count && !*cancelled; first += ChunkParts) {
+      size_t const chunk = std::min(ChunkParts, count - first);
+      WorkerPool::parallelFor(chunk, [&](size_t i) {
+        if (*cancelled) { return; }
+        size_t const part = first + i;
+        Bnd_Box reach = partIndex.partBox(part);
+        if (reach.IsVoid()) { return; }
+        reach.Enlarge(radius);
+        (*work)[part] = bakePart(meshes, part, partIndex.partsInBox(reach),
+                                 directions, radius);
+      });
+      if (*cancelled) { return; }
+
+      std::lock_guard<std::mutex> lock(inbox->mutex);
+      for (size_t part = first; part < first + chunk; ++part) {
+        inbox->parts.push_back(part);
+      }
+    }
+    if (*cancelled) { return; }
+
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      cache.rays = rayCount;
+      cache.occlusion = work;
+    }
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    inbox->milliseconds = emscripten_get_now() - start;
+  });
+}
+
+OcclusionBaker::~OcclusionBaker() { *cancelled = true; }
+
+std::vector<size_t> OcclusionBaker::takeBaked() {
+  std::vector<size_t> parts;
+  {
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    std::swap(parts, inbox->parts);
+    if (inbox->cached) {
+      values = std::move(inbox->cached);
+      inbox->cached.reset();
+      for (size_t part = 0; part < baked.size(); ++part) { parts.push_back(part); }
+    }
+    milliseconds = inbox->milliseconds;
+  }
+  for (size_t part : parts) {
+    if (!baked[part]) {
+      baked[part] = true;
+      ++bakedParts;
+    }
+  }
+  return parts;
+}
+
+std::vector<uint8_t> const *OcclusionBaker::occlusion(size_t part) const {
+  return part < baked.size() && baked[part] ? &(*values)[part] : nullptr;
+}
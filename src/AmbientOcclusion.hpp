@@ -0,0 +1,74 @@
+#ifndef AMBIENTOCCLUSION_HPP
+#define AMBIENTOCCLUSION_HPP
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <opencascade/Graphic3d_ShaderProgram.hxx>
+#include <vector>
+
+struct LoadedModel;
+
+// Ambient occlusion of every part of a model, by part index: one byte per
+// vertex, in the order forEachTriangulation() visits the nodes, from 0 for
+// fully occluded to 255 for open.
+using PartOcclusion = std::vector<std::vector<uint8_t>>;
+
+/**
+ * Shader for triangle arrays with world-space vertices whose vertex color
+ * holds the occlusion in its red channel. It lights like QuantizedPart's,
+ * from the viewer, and darkens occluded vertices.
+ */
+Handle(Graphic3d_ShaderProgram) const &occlusionShaderProgram();
+
+/**
+ * Bakes the ambient occlusion of a model's parts on the worker pool: rays
+ * over the hemisphere of every vertex, against the triangles of the parts
+ * the part index finds within RadiusFraction of the model's size. Parts
+ * are baked ChunkParts at a time and handed over as they finish, so that
+ * the occlusion fills in progressively. A finished bake is cached in the
+ * model for its ray count.
+ *
+ * Lives on the main thread; destroying the baker cancels the bake.
+ */
+class OcclusionBaker {
+public:
+  static constexpr size_t ChunkParts = 64;
+  static constexpr double RadiusFraction = 0.05;
+
+  /** @param rays Rays per vertex. */
+  OcclusionBaker(std::shared_ptr<LoadedModel> const &model, int rays);
+  ~OcclusionBaker();
+
+  /** Parts whose occlusion arrived since the last call. */
+  std::vector<size_t> takeBaked();
+  /** The occlusion of a baked part, null before. */
+  std::vector<uint8_t> const *occlusion(size_t part) const;
+
+  int rayCount() const { return rays; }
+  size_t partCount() const { return baked.size(); }
+  size_t bakedCount() const { return bakedParts; }
+  bool isDone() const { return bakedParts == baked.size(); }
+  /** Milliseconds the bake took, from the cache too; -1 before done. */
+  double bakeTime() const { return milliseconds; }
+
+private:
+  // Written by the pool, drained by takeBaked().
+  struct Inbox {
+    std::mutex mutex;
+    std::vector<size_t> parts;
+    std::shared_ptr<PartOcclusion const> cached;
+    double milliseconds = -1.0;
+  };
+
+  int rays = 0;
+  std::shared_ptr<Inbox> inbox;
+  std::shared_ptr<std::atomic<bool>> cancelled;
+  // Only read for parts handed over by the inbox.
+  std::shared_ptr<PartOcclusion const> values;
+  std::vector<bool> baked;
+  size_t bakedParts = 0;
+  double milliseconds = -1.0;
+};
+
+#endif // AMBIENTOCCLUSION_HPP
@@ -0,0 +1,287 @@
+#include "BatchedParts.hpp"
+#include "AmbientOcclusion.hpp"
+#include "OCCTUtilities.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <opencascade/AIS_InteractiveContext.hxx>
+#include <opencascade/Graphic3d_AttribBuffer.hxx>
+#include <opencascade/Graphic3d_MutableIndexBuffer.hxx>
+#include <opencascade/Prs3d_ShadingAspect.hxx>
+#include <opencascade/Select3D_SensitivePrimitiveArray.hxx>
+#include <opencascade/SelectMgr_Selection.hxx>
+#include <opencascade/StdPrs_ToolTriangulatedShape.hxx>
+
+namespace {
+
+bool sameColor(std::optional<Quantity_Color> const &a,
+               std::optional<Quantity_Color> const &b) {
+  return a.has_value() == b.has_value() && (!a || a->IsEqual(*b));
+}
+
+} // namespace
+
+BatchedParts::BatchedParts(std::vector<ModelPart> const &parts, bool occlusion)
+    : occlusion(occlusion) {
+  TRACE_SCOPE("BatchedParts");
+  ranges.resize(parts.size());
+
+  // First pass: assign every part a batch of its color with room left.
+  struct BatchSize {
+    int vertices = 0;
+    int indices = 0;
+  };
+  std::vector<BatchSize> sizes;
+  std::vector<size_t> openBatch; // last batch per distinct color
+  for (size_t i = 0; i < parts.size(); ++i) {
+    BatchSize part;
+    forEachTriangulation(parts[i].shape, [&part](TopoDS_Face const &,
+                                                 Handle(Poly_Triangulation) const &tri,
+                                                 TopLoc_Location const &) {
+      part.vertices += tri->NbNodes();
+      part.indices += 3 * tri->NbTriangles();
+    });
+
+    // A part larger than a batch gets one of its own, with 32-bit indices.
+    auto open = std::find_if(openBatch.begin(), openBatch.end(), [&](size_t b) {
+      return sameColor(batches[b].color, parts[i].color);
+    });
+    if (open == openBatch.end() ||
+        sizes[*open].vertices + part.vertices > MaxBatchVertices) {
+      batches.push_back({parts[i].color, Handle(Graphic3d_ArrayOfTriangles)()});
+      sizes.emplace_back();
+      if (open == openBatch.end()) {
+        open = openBatch.insert(openBatch.end(), batches.size() - 1);
+      } else {
+        *open = batches.size() - 1;
+      }
+    }
+    size_t const batch = *open;
+
+    ranges[i].batch = batch;
+    ranges[i].firstVertex = sizes[batch].vertices;
+    ranges[i].vertexCount = part.vertices;
+    ranges[i].firstIndex = sizes[batch].indices;
+    ranges[i].indexCount = part.indices;
+    sizes[batch].vertices += part.vertices;
+    sizes[batch].indices += part.indices;
+  }
+
+  Graphic3d_ArrayFlags flags =
+      Graphic3d_ArrayFlags_VertexNormal | Graphic3d_ArrayFlags_IndexMutable;
+  if (occlusion) {
+    flags |= Graphic3d_ArrayFlags_VertexColor | Graphic3d_ArrayFlags_AttribsMutable;
+  }
+  for (size_t b = 0; b < batches.size(); ++b) {
+    batches[b].triangles =
+        new Graphic3d_ArrayOfTriangles(sizes[b].vertices, sizes[b].indices, flags);
+  }
+
+  // Second pass: append world-space vertices and indices in part order, so
+  // that they land in the ranges assigned above.
+  for (size_t i = 0; i < parts.size(); ++i) {
+    Handle(Graphic3d_ArrayOfTriangles) const &array =
+        batches[ranges[i].batch].triangles;
+    forEachTriangulation(parts[i].shape, [&array, occlusion](
+                                             TopoDS_Face const &face,
+                                             Handle(Poly_Triangulation) const &tri,
+                                             TopLoc_Location const &location) {
+      // meshShape() computed the normals; the shared triangulation is only
+      // read here, so missing ones go into a copy.
+      Handle(Poly_Triangulation) withNormals = tri;
+      if (!withNormals->HasNormals()) {
+        withNormals = new Poly_Triangulation(tri);
+        StdPrs_ToolTriangulatedShape::ComputeNormals(face, withNormals);
+      }
+      gp_Trsf const trsf = location.Transformation();
+      bool const reversed = face.Orientation() == TopAbs_REVERSED;
+
+      int const base = array->VertexNumber();
+      for (int n = 1; n <= tri->NbNodes(); ++n) {
+        gp_Dir normal = withNormals->Normal(n).Transformed(trsf);
+        if (reversed) { normal.Reverse(); }
+        int const vertex = array->AddVertex(tri->Node(n).Transformed(trsf), normal);
+        if (occlusion) { array->SetVertexColor(vertex, Graphic3d_Vec4ub(255)); }
+      }
+      for (int t = 1; t <= tri->NbTriangles(); ++t) {
+        int a, b, c;
+        tri->Triangle(t).Get(a, b, c);
+        if (reversed) { std::swap(b, c); }
+        array->AddTriangleEdges(base + a, base + b, base + c);
+      }
+    });
+  }
+}
+
+void BatchedParts::setPartVisible(size_t part, bool visible) {
+  if (part >= ranges.size() || ranges[part].visible == visible) { return; }
+
+  PartRange &range = ranges[part];
+  Handle(Graphic3d_IndexBuffer) const &indices =
+      batches[range.batch].triangles->Indices();
+  if (range.indexCount == 0) {
+    range.visible = visible;
+    return;
+  }
+
+  int const first = range.firstIndex;
+  int const last = range.firstIndex + range.indexCount - 1;
+  if (!visible) {
+    std::vector<int> &saved = hiddenIndices[part];
+    saved.resize(range.indexCount);
+    for (int k = 0; k < range.indexCount; ++k) {
+      saved[k] = indices->Index(first + k);
+    }
+    // Degenerate triangles are dropped by the rasterizer.
+    for (int k = 0; k < range.indexCount; ++k) {
+      indices->SetIndex(first + k, saved[0]);
+    }
+  } else {
+    auto it = hiddenIndices.find(part);
+    for (int k = 0; k < range.indexCount; ++k) {
+      indices->SetIndex(first + k, it->second[k]);
+    }
+    hiddenIndices.erase(it);
+  }
+  range.visible = visible;
+
+  // Uploads only the changed range on the next redraw.
+  if (auto mutableIndices =
+          Handle(Graphic3d_MutableIndexBuffer)::DownCast(indices)) {
+    mutableIndices->Invalidate(first, last);
+  }
+}
+
+bool BatchedParts::isPartVisible(size_t part) const {
+  return part < ranges.size() && ranges[part].visible;
+}
+
+void BatchedParts::setPartOcclusion(size_t part, std::vector<uint8_t> const &values) {
+  if (!occlusion || part >= ranges.size()) { return; }
+  PartRange const &range = ranges[part];
+  if (range.vertexCount == 0 || values.size() != size_t(range.vertexCount)) {
+    return;
+  }
+
+  Handle(Graphic3d_ArrayOfTriangles) const &array = batches[range.batch].triangles;
+  for (int k = 0; k < range.vertexCount; ++k) {
+    array->SetVertexColor(range.firstVertex + k + 1,
+                          Graphic3d_Vec4ub(values[k], values[k], values[k], 255));
+  }
+  if (auto attributes = Handle(Graphic3d_AttribBuffer)::DownCast(array->Attributes())) {
+    attributes->Invalidate(range.firstVertex, range.firstVertex + range.vertexCount - 1);
+  }
+}
+
+void BatchedParts::Compute(Handle(PrsMgr_PresentationManager) const &,
+                           Handle(Prs3d_Presentation) const &prs,
+                           Standard_Integer const mode) {
+  if (mode != 1) { return; }
+
+  for (auto const &batch : batches) {
+    if (batch.triangles->VertexNumber() == 0) { continue; }
+
+    Handle(Prs3d_ShadingAspect) shading = new Prs3d_ShadingAspect();
+    shading->SetMaterial(myDrawer->ShadingAspect()->Material());
+    if (batch.color) { shading->SetColor(*batch.color); }
+    if (occlusion) {
+      Handle(Graphic3d_AspectFillArea3d) const &aspect = shading->Aspect();
+      aspect->SetShadingModel(Graphic3d_TypeOfShadingModel_Unlit);
+      aspect->SetInteriorColor(batch.color ? *batch.color
+                                           : myDrawer->ShadingAspect()->Color());
+      aspect->SetShaderProgram(occlusionShaderProgram());
+    }
+
+    Handle(Graphic3d_Group) group = prs->NewGroup();
+    group->SetGroupPrimitivesAspect(shading->Aspect());
+    group->AddPrimitiveArray(batch.triangles);
+  }
+}
+
+void BatchedParts::ComputeSelection(Handle(SelectMgr_Selection) const &selection,
+                                    Standard_Integer const mode) {
+  if (mode != 0) { return; }
+
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    PartRange const &range = ranges[i];
+    if (!range.visible || range.indexCount == 0) { continue; }
+
+    Handle(Graphic3d_ArrayOfTriangles) const &array =
+        batches[range.batch].triangles;
+    Handle(BatchedPartOwner) owner = new BatchedPartOwner(this, i);
+    Handle(Select3D_SensitivePrimitiveArray) sensitive =
+        new Select3D_SensitivePrimitiveArray(owner);
+    sensitive->InitTriangulation(array->Attributes(), array->Indices(),
+                                 TopLoc_Location(), range.firstIndex,
+                                 range.firstIndex + range.indexCount - 1);
+    selection->Add(sensitive);
+  }
+}
+
+void BatchedParts::HilightSelected(Handle(PrsMgr_PresentationManager) const &prsMgr,
+                                   SelectMgr_SequenceOfOwner const &owners) {
+  Handle(Prs3d_Drawer) style = HilightAttributes();
+  if (style.IsNull() && HasInteractiveContext()) {
+    style = GetContext()->HighlightStyle(Prs3d_TypeOfHighlight_Selected);
+  }
+
+  std::vector<size_t> parts;
+  for (SelectMgr_SequenceOfOwner::Iterator it(owners); it.More(); it.Next()) {
+    if (auto owner = Handle(BatchedPartOwner)::DownCast(it.Value())) {
+      parts.push_back(owner->part);
+    }
+  }
+
+  Handle(Prs3d_Presentation) prs = GetSelectPresentation(prsMgr);
+  prs->Clear();
+  addHighlight(prs, parts, style.IsNull() ? Quantity_Color(Quantity_NOC_GRAY80) : style->Color());
+  prs->SetZLayer(Graphic3d_ZLayerId_Top);
+  prs->Display();
+}
+
+void BatchedParts::HilightOwnerWithColor(
+    Handle(PrsMgr_PresentationManager) const &prsMgr,
+    Handle(Prs3d_Drawer) const &style, Handle(SelectMgr_EntityOwner) const &owner) {
+  auto partOwner = Handle(BatchedPartOwner)::DownCast(owner);
+  if (partOwner.IsNull()) { return; }
+
+  Handle(Prs3d_Presentation) prs = GetHilightPresentation(prsMgr);
+  prs->Clear();
+  addHighlight(prs, {partOwner->part}, style->Color());
+  prs->SetZLayer(Graphic3d_ZLayerId_Top);
+  if (prsMgr->IsImmediateModeOn()) {
+    prsMgr->AddToImmediateList(prs);
+  } else {
+    prs->Display();
+  }
+}
+
+void BatchedParts::addHighlight(Handle(Prs3d_Presentation) const &prs,
+                                std::vector<size_t> const &parts,
+                                Quantity_Color const &color) const {
+  int indexCount = 0;
+  for (size_t part : parts) {
+    if (isPartVisible(part)) { indexCount += ranges[part].indexCount; }
+  }
+  if (indexCount == 0) { return; }
+
+  // Copies the triangles of the ranges, without sharing vertices.
+  Handle(Graphic3d_ArrayOfTriangles) triangles = new Graphic3d_ArrayOfTriangles(
+      indexCount, 0, Graphic3d_ArrayFlags_VertexNormal);
+  for (size_t part : parts) {
+    if (!isPartVisible(part)) { continue; }
+
+    PartRange const &range = ranges[part];
+    Handle(Graphic3d_ArrayOfTriangles) const &source =
+        batches[range.batch].triangles;
+    for (int k = 0; k < range.indexCount; ++k) {
+      int const vertex = source->Indices()->Index(range.firstIndex + k) + 1;
+      triangles->AddVertex(source->Vertice(vertex), source->VertexNormal(vertex));
+    }
+  }
+
+  Handle(Prs3d_ShadingAspect) shading = new Prs3d_ShadingAspect();
+  shading->SetColor(color);
+  Handle(Graphic3d_Group) group = prs->NewGroup();
+  group->SetGroupPrimitivesAspect(shading->Aspect());
+  group->AddPrimitiveArray(triangles);
+}
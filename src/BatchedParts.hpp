@@ -0,0 +1,108 @@
+#ifndef BATCHEDPARTS_HPP
+#define BATCHEDPARTS_HPP
+#include "ModelRegistry.hpp"
+#include <opencascade/AIS_InteractiveObject.hxx>
+#include <opencascade/Graphic3d_ArrayOfTriangles.hxx>
+#include <opencascade/SelectMgr_EntityOwner.hxx>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Displays many static parts as a few large triangle arrays, one set per
+ * color, instead of one structure per part. Every part remembers the vertex
+ * and index range it occupies, which is what picking, highlighting and
+ * hiding work on. Hidden parts keep their range; their triangles are
+ * collapsed to a point in a mutable index buffer.
+ *
+ * With occlusion, every vertex also carries its ambient occlusion in a
+ * mutable vertex color, which occlusionShaderProgram() shades with. It
+ * starts open and is filled in part by part.
+ *
+ * Parts must be triangulated before the object is displayed.
+ */
+class BatchedParts : public AIS_InteractiveObject {
+  DEFINE_STANDARD_RTTI_INLINE(BatchedParts, AIS_InteractiveObject)
+public:
+  // Keeps every array within 16-bit indices, which WebGL 1 always supports.
+  static int const MaxBatchVertices = 65535;
+
+  /**
+   * @param parts The parts, triangulated.
+   * @param occlusion Whether to shade with baked ambient occlusion.
+   */
+  BatchedParts(std::vector<ModelPart> const &parts, bool occlusion = false);
+
+  size_t partCount() const { return ranges.size(); }
+  size_t batchCount() const { return batches.size(); }
+
+  /**
+   * Shows or hides a part without rebuilding the arrays. Selection has to
+   * be recomputed afterwards for hidden parts to stop being pickable.
+   */
+  void setPartVisible(size_t part, bool visible);
+  bool isPartVisible(size_t part) const;
+
+  bool hasOcclusion() const { return occlusion; }
+  /**
+   * Sets the ambient occlusion of a part's vertices; uploads only the
+   * part's range on the next redraw. Ignored without occlusion, or when
+   * the values do not match the part's vertices.
+   */
+  void setPartOcclusion(size_t part, std::vector<uint8_t> const &values);
+
+  Standard_Boolean AcceptDisplayMode(Standard_Integer const mode) const override {
+    return mode == 1;
+  }
+
+  void Compute(Handle(PrsMgr_PresentationManager) const &prsMgr,
+               Handle(Prs3d_Presentation) const &prs,
+               Standard_Integer const mode) override;
+  void ComputeSelection(Handle(SelectMgr_Selection) const &selection,
+                        Standard_Integer const mode) override;
+
+  // Highlighting draws the ranges of the picked parts on top.
+  Standard_Boolean IsAutoHilight() const override { return Standard_False; }
+  void HilightSelected(Handle(PrsMgr_PresentationManager) const &prsMgr,
+                       SelectMgr_SequenceOfOwner const &owners) override;
+  void HilightOwnerWithColor(Handle(PrsMgr_PresentationManager) const &prsMgr,
+                             Handle(Prs3d_Drawer) const &style,
+                             Handle(SelectMgr_EntityOwner) const &owner) override;
+
+private:
+  struct Batch {
+    std::optional<Quantity_Color> color;
+    Handle(Graphic3d_ArrayOfTriangles) triangles;
+  };
+
+  struct PartRange {
+    size_t batch = 0;
+    int firstVertex = 0; // 0-based position in the vertex buffer
+    int vertexCount = 0;
+    int firstIndex = 0;  // 0-based position in the index buffer
+    int indexCount = 0;
+    bool visible = true;
+  };
+
+  bool occlusion = false;
+  std::vector<Batch> batches;
+  std::vector<PartRange> ranges;
+  std::unordered_map<size_t, std::vector<int>> hiddenIndices;
+
+  void addHighlight(Handle(Prs3d_Presentation) const &prs,
+                    std::vector<size_t> const &parts,
+                    Quantity_Color const &color) const;
+};
+
+/** Picking owner of one part of a BatchedParts object. */
+class BatchedPartOwner : public SelectMgr_EntityOwner {
+  DEFINE_STANDARD_RTTI_INLINE(BatchedPartOwner, SelectMgr_EntityOwner)
+public:
+  BatchedPartOwner(Handle(SelectMgr_SelectableObject) const &object,
+                   size_t part)
+      : SelectMgr_EntityOwner(object, 5), part(part) {}
+
+  size_t const part;
+};
+
+#endif // BATCHEDPARTS_HPP
@@ -0,0 +1,277 @@
+#include "FeatureEdges.hpp"
+#include "OCCTUtilities.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <opencascade/Graphic3d_ArrayOfSegments.hxx>
+#include <opencascade/Graphic3d_AspectLine3d.hxx>
+#include <opencascade/Prs3d_Presentation.hxx>
+#include <unordered_map>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+struct Position {
+  float x, y, z;
+
+  bool operator==(Position const &other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+struct PositionHash {
+  size_t operator()(Position const &p) const {
+    uint32_t bits[3];
+    std::memcpy(bits, &p, sizeof(bits));
+    return size_t(bits[0]) * 73856093u ^ size_t(bits[1]) * 19349663u ^
+           size_t(bits[2]) * 83492791u;
+  }
+};
+
+// The triangles of a shape over welded nodes, with unnormalized normals.
+struct Mesh {
+  std::vector<float> x, y, z;
+  std::vector<uint32_t> corners; // three per triangle
+  std::vector<float> nx, ny, nz, length;
+
+  size_t triangleCount() const { return corners.size() / 3; }
+};
+
+Mesh weld(TopoDS_Shape const &shape) {
+  Mesh mesh;
+  std::unordered_map<Position, uint32_t, PositionHash> nodes;
+  std::vector<uint32_t> faceNodes;
+  forEachTriangulation(shape, [&](TopoDS_Face const &face,
+                                  Handle(Poly_Triangulation) const &tri,
+                                  TopLoc_Location const &location) {
+    gp_Trsf const trsf = location.Transformation();
+    faceNodes.resize(tri->NbNodes() + 1);
+    for (int n = 1; n <= tri->NbNodes(); ++n) {
+      gp_Pnt const p = tri->Node(n).Transformed(trsf);
+      Position const key{float(p.X()), float(p.Y()), float(p.Z())};
+      auto const [it, added] = nodes.emplace(key, uint32_t(mesh.x.size()));
+      if (added) {
+        mesh.x.push_back(key.x);
+        mesh.y.push_back(key.y);
+        mesh.z.push_back(key.z);
+      }
+      faceNodes[n] = it->second;
+    }
+
+    bool const reversed = face.Orientation() == TopAbs_REVERSED;
+    for (int t = 1; t <= tri->NbTriangles(); ++t) {
+      int a, b, c;
+      tri->Triangle(t).Get(a, b, c);
+      if (reversed) { std::swap(b, c); }
+      uint32_t const ia = faceNodes[a], ib = faceNodes[b], ic = faceNodes[c];
+      // Welding collapses the slivers along degenerate edges.
+      if (ia == ib || ib == ic || ia == ic) { continue; }
+      mesh.corners.insert(mesh.corners.end(), {ia, ib, ic});
+    }
+  });
+  return mesh;
+}
+
+void computeNormals(Mesh &mesh) {
+  size_t const count = mesh.triangleCount();
+  mesh.nx.resize(count);
+  mesh.ny.resize(count);
+  mesh.nz.resize(count);
+  mesh.length.resize(count);
+  uint32_t const *c = mesh.corners.data();
+  float const *x = mesh.x.data(), *y = mesh.y.data(), *z = mesh.z.data();
+
+  size_t t = 0;
+#ifdef __wasm_simd128__
+  auto gather = [c](float const *v, size_t first, int corner) {
+    uint32_t const *at = c + 3 * first + corner;
+    return wasm_f32x4_make(v[at[0]], v[at[3]], v[at[6]], v[at[9]]);
+  };
+  for (; t + 4 <= count; t += 4) {
+    v128_t const ax = gather(x, t, 0), ay = gather(y, t, 0), az = gather(z, t, 0);
+    v128_t const ux = wasm_f32x4_sub(gather(x, t, 1), ax);
+    v128_t const uy = wasm_f32x4_sub(gather(y, t, 1), ay);
+    v128_t const uz = wasm_f32x4_sub(gather(z, t, 1), az);
+    v128_t const vx = wasm_f32x4_sub(gather(x, t, 2), ax);
+    v128_t const vy = wasm_f32x4_sub(gather(y, t, 2), ay);
+    v128_t const vz = wasm_f32x4_sub(gather(z, t, 2), az);
+    v128_t const nx = wasm_f32x4_sub(wasm_f32x4_mul(uy, vz), wasm_f32x4_mul(uz, vy));
+    v128_t const ny = wasm_f32x4_sub(wasm_f32x4_mul(uz, vx), wasm_f32x4_mul(ux, vz));
+    v128_t const nz = wasm_f32x4_sub(wasm_f32x4_mul(ux, vy), wasm_f32x4_mul(uy, vx));
+    v128_t const squared = wasm_f32x4_add(
+        wasm_f32x4_add(wasm_f32x4_mul(nx, nx), wasm_f32x4_mul(ny, ny)),
+        wasm_f32x4_mul(nz, nz));
+    wasm_v128_store(&mesh.nx[t], nx);
+    wasm_v128_store(&mesh.ny[t], ny);
+    wasm_v128_store(&mesh.nz[t], nz);
+    wasm_v128_store(&mesh.length[t], wasm_f32x4_sqrt(squared));
+  }
+#endif
+  for (; t < count; ++t) {
+    uint32_t const a = c[3 * t], b = c[3 * t + 1], d = c[3 * t + 2];
+    float const ux = x[b] - x[a], uy = y[b] - y[a], uz = z[b] - z[a];
+    float const vx = x[d] - x[a], vy = y[d] - y[a], vz = z[d] - z[a];
+    mesh.nx[t] = uy * vz - uz * vy;
+    mesh.ny[t] = uz * vx - ux * vz;
+    mesh.nz[t] = ux * vy - uy * vx;
+    mesh.length[t] = std::sqrt(mesh.nx[t] * mesh.nx[t] + mesh.ny[t] * mesh.ny[t] +
+                               mesh.nz[t] * mesh.nz[t]);
+  }
+}
+
+// Edges between two triangles that are candidates for the angle test.
+struct Pairs {
+  std::vector<uint32_t> first, second;
+  std::vector<uint64_t> edges;
+};
+
+// Appends the pairs whose normals are further apart than the angle.
+void testAngles(Mesh const &mesh, Pairs const &pairs, float cosAngle,
+                std::vector<uint64_t> &features) {
+  size_t const count = pairs.edges.size();
+  uint32_t const *a = pairs.first.data(), *b = pairs.second.data();
+  float const *nx = mesh.nx.data(), *ny = mesh.ny.data(), *nz = mesh.nz.data();
+  float const *length = mesh.length.data();
+
+  // A triangle without area has no normal, and no angle to its neighbours.
+  size_t i = 0;
+#ifdef __wasm_simd128__
+  auto gather = [](float const *v, uint32_t const *index, size_t first) {
+    uint32_t const *at = index + first;
+    return wasm_f32x4_make(v[at[0]], v[at[1]], v[at[2]], v[at[3]]);
+  };
+  v128_t const threshold = wasm_f32x4_splat(cosAngle);
+  for (; i + 4 <= count; i += 4) {
+    v128_t const dot = wasm_f32x4_add(
+        wasm_f32x4_add(wasm_f32x4_mul(gather(nx, a, i), gather(nx, b, i)),
+                       wasm_f32x4_mul(gather(ny, a, i), gather(ny, b, i))),
+        wasm_f32x4_mul(gather(nz, a, i), gather(nz, b, i)));
+    v128_t const lengths = wasm_f32x4_mul(gather(length, a, i), gather(length, b, i));
+    uint32_t const mask = wasm_i32x4_bitmask(
+        wasm_f32x4_lt(dot, wasm_f32x4_mul(threshold, lengths)));
+    for (uint32_t bits = mask; bits; bits &= bits - 1) {
+      features.push_back(pairs.edges[i + __builtin_ctz(bits)]);
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    float const dot = nx[a[i]] * nx[b[i]] + ny[a[i]] * ny[b[i]] + nz[a[i]] * nz[b[i]];
+    if (dot < cosAngle * length[a[i]] * length[b[i]]) {
+      features.push_back(pairs.edges[i]);
+    }
+  }
+}
+
+} // namespace
+
+std::vector<float> extractFeatureEdges(TopoDS_Shape const &shape, double angle) {
+  Mesh mesh = weld(shape);
+  computeNormals(mesh);
+
+  // Every edge once per triangle, as the sorted pair of its nodes; sorting
+  // brings the triangles of an edge together.
+  size_t const count = mesh.triangleCount();
+  std::vector<std::pair<uint64_t, uint32_t>> edges;
+  edges.reserve(3 * count);
+  for (size_t t = 0; t < count; ++t) {
+    for (int corner = 0; corner < 3; ++corner) {
+      uint32_t const a = mesh.corners[3 * t + corner];
+      uint32_t const b = mesh.corners[3 * t + (corner + 1) % 3];
+      edges.push_back({uint64_t(std::min(a, b)) << 32 | std::max(a, b), uint32_t(t)});
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  std::vector<uint64_t> features;
+  Pairs pairs;
+  for (size_t i = 0; i < edges.size();) {
+    size_t end = i + 1;
+    while (end < edges.size() && edges[end].first == edges[i].first) { ++end; }
+    if (end - i == 2) {
+      pairs.first.push_back(edges[i].second);
+      pairs.second.push_back(edges[i + 1].second);
+      pairs.edges.push_back(edges[i].first);
+    } else {
+      // Boundaries, and edges shared by more than two triangles.
+      features.push_back(edges[i].first);
+    }
+    i = end;
+  }
+  testAngles(mesh, pairs, float(std::cos(angle)), features);
+
+  std::vector<float> segments;
+  segments.reserve(6 * features.size());
+  for (uint64_t edge : features) {
+    for (uint32_t node : {uint32_t(edge >> 32), uint32_t(edge)}) {
+      segments.insert(segments.end(), {mesh.x[node], mesh.y[node], mesh.z[node]});
+    }
+  }
+  return segments;
+}
+
+std::vector<Handle(FeatureEdgeBatch)>
+FeatureEdgeBatch::create(std::shared_ptr<PartEdges const> const &edges) {
+  std::vector<Handle(FeatureEdgeBatch)> batches;
+  size_t first = 0;
+  size_t vertices = 0;
+  for (size_t part = 0; part < edges->size(); ++part) {
+    size_t const partVertices = (*edges)[part].size() / 3;
+    if (part > first && vertices + partVertices > MaxBatchVertices) {
+      batches.push_back(new FeatureEdgeBatch(edges, first, part - first));
+      first = part;
+      vertices = 0;
+    }
+    vertices += partVertices;
+  }
+  if (first < edges->size()) {
+    batches.push_back(new FeatureEdgeBatch(edges, first, edges->size() - first));
+  }
+  return batches;
+}
+
+FeatureEdgeBatch::FeatureEdgeBatch(std::shared_ptr<PartEdges const> const &edges,
+                                   size_t first, size_t count)
+    : edges(edges), first(first), visible(count, true) {}
+
+size_t FeatureEdgeBatch::segmentCount() const {
+  size_t count = 0;
+  for (size_t i = 0; i < visible.size(); ++i) {
+    count += (*edges)[first + i].size() / 6;
+  }
+  return count;
+}
+
+void FeatureEdgeBatch::setPartVisible(size_t part, bool value) {
+  if (part >= first && part - first < visible.size()) {
+    visible[part - first] = value;
+  }
+}
+
+void FeatureEdgeBatch::Compute(Handle(PrsMgr_PresentationManager) const &,
+                               Handle(Prs3d_Presentation) const &prs,
+                               Standard_Integer const) {
+  size_t vertices = 0;
+  for (size_t i = 0; i < visible.size(); ++i) {
+    if (visible[i]) { vertices += (*edges)[first + i].size() / 3; }
+  }
+  if (vertices == 0) { return; }
+
+  Handle(Graphic3d_ArrayOfSegments) segments =
+      new Graphic3d_ArrayOfSegments(int(vertices));
+  for (size_t i = 0; i < visible.size(); ++i) {
+    if (!visible[i]) { continue; }
+    std::vector<float> const &points = (*edges)[first + i];
+    for (size_t p = 0; p + 2 < points.size(); p += 3) {
+      segments->AddVertex(points[p], points[p + 1], points[p + 2]);
+    }
+  }
+
+  Handle(Graphic3d_Group) group = prs->NewGroup();
+  group->SetGroupPrimitivesAspect(
+      new Graphic3d_AspectLine3d(Quantity_NOC_BLACK, Aspect_TOL_SOLID, 1.0));
+  group->AddPrimitiveArray(segments);
+}
@@ -0,0 +1,75 @@
+#ifndef FEATUREEDGES_HPP
+#define FEATUREEDGES_HPP
+#include <memory>
+#include <mutex>
+#include <opencascade/AIS_InteractiveObject.hxx>
+#include <opencascade/TopoDS_Shape.hxx>
+#include <vector>
+
+// Feature edges of every part of a model, by part index: pairs of
+// world-space points as x, y, z floats.
+using PartEdges = std::vector<std::vector<float>>;
+
+// Feature edges of a model's parts, extracted on first use for one angle,
+// attached to the model and shared by the viewers that show them.
+struct FeatureEdgeCache {
+  std::mutex mutex;
+  double angle = -1.0;
+  std::shared_ptr<PartEdges const> edges;
+};
+
+/**
+ * Extracts the feature edges of a shape from its triangulation: edges of
+ * one triangle only, edges of more than two, and edges whose triangles
+ * meet at more than an angle. Faces are joined where their nodes have the
+ * same position. Built with -msimd128, the normals and angles are computed
+ * four triangles and edges at a time.
+ *
+ * @param shape A triangulated shape.
+ * @param angle The smallest angle between two triangles, in radians, for
+ *              the edge between them to be a feature.
+ */
+std::vector<float> extractFeatureEdges(TopoDS_Shape const &shape, double angle);
+
+/**
+ * The feature edges of a run of consecutive parts, drawn as one segment
+ * array without selection, so that an overlay over many parts is a few
+ * line buffers rather than one presentation per part. Hiding a part
+ * rebuilds the array of its batch only.
+ */
+class FeatureEdgeBatch : public AIS_InteractiveObject {
+  DEFINE_STANDARD_RTTI_INLINE(FeatureEdgeBatch, AIS_InteractiveObject)
+public:
+  static size_t const MaxBatchVertices = 1 << 18;
+
+  /** Splits all parts into batches of at most MaxBatchVertices. */
+  static std::vector<Handle(FeatureEdgeBatch)>
+  create(std::shared_ptr<PartEdges const> const &edges);
+
+  size_t firstPart() const { return first; }
+  size_t partCount() const { return visible.size(); }
+  size_t segmentCount() const;
+
+  /** Takes effect on the next Redisplay(). */
+  void setPartVisible(size_t part, bool value);
+
+  Standard_Boolean AcceptDisplayMode(Standard_Integer const mode) const override {
+    return mode == 0;
+  }
+
+  void Compute(Handle(PrsMgr_PresentationManager) const &prsMgr,
+               Handle(Prs3d_Presentation) const &prs,
+               Standard_Integer const mode) override;
+  void ComputeSelection(Handle(SelectMgr_Selection) const &,
+                        Standard_Integer const) override {}
+
+private:
+  FeatureEdgeBatch(std::shared_ptr<PartEdges const> const &edges, size_t first,
+                   size_t count);
+
+  std::shared_ptr<PartEdges const> edges;
+  size_t first = 0;
+  std::vector<bool> visible;
+};
+
+#endif // FEATUREEDGES_HPP
@@ -0,0 +1,110 @@
+#include "GpuPicker.hpp"
+#include "Trace.hpp"
+#include <opencascade/Graphic3d_CameraTile.hxx>
+#include <opencascade/OpenGl_Context.hxx>
+#include <opencascade/OpenGl_GraphicDriver.hxx>
+#include <opencascade/Prs3d_ShadingAspect.hxx>
+#include <opencascade/V3d_ImageDumpOptions.hxx>
+#include <opencascade/V3d_Viewer.hxx>
+
+namespace {
+
+// Ids are written as linear RGB bytes. An sRGB conversion would round them
+// on the way in, so pick() only trusts values that name a part.
+Quantity_Color idColor(unsigned int id) {
+  return Quantity_Color(((id >> 16) & 0xFF) / 255.0, ((id >> 8) & 0xFF) / 255.0,
+                        (id & 0xFF) / 255.0, Quantity_TOC_RGB);
+}
+
+} // namespace
+
+GpuPicker::GpuPicker(Handle(V3d_View) const &view) : mainView(view) {
+  Handle(V3d_Viewer) viewer = new V3d_Viewer(mainView->Viewer()->Driver());
+  viewer->SetComputedMode(false);
+  viewer->SetDefaultShadingModel(Graphic3d_TypeOfShadingModel_Unlit);
+  viewer->SetDefaultBackgroundColor(Quantity_NOC_BLACK);
+
+  Graphic3d_Vec2i size;
+  mainView->Window()->Size(size.x(), size.y());
+  window = new Aspect_NeutralWindow();
+  window->SetSize(size.x(), size.y());
+
+  this->view = viewer->CreateView();
+  this->view->SetImmediateUpdate(false);
+  this->view->ChangeRenderingParams().NbMsaaSamples = 0;
+  this->view->ChangeRenderingParams().RenderResolutionScale = 1.0f;
+  // Shares the context of the regular view: the driver's, which is not
+  // necessarily current when several viewers exist.
+  Aspect_RenderingContext glContext = nullptr;
+  auto driver = Handle(OpenGl_GraphicDriver)::DownCast(viewer->Driver());
+  if (!driver.IsNull() && !driver->GetSharedContext().IsNull()) {
+    glContext = driver->GetSharedContext()->RenderingContext();
+  }
+  this->view->SetWindow(window, glContext);
+  context = new AIS_InteractiveContext(viewer);
+}
+
+void GpuPicker::setParts(std::vector<ModelPart> const &parts) {
+  TRACE_SCOPE("GpuPicker::setParts");
+  clear();
+  objects.reserve(parts.size());
+  for (size_t i = 0; i < parts.size(); ++i) {
+    Handle(AIS_Shape) object = new AIS_Shape(parts[i].shape);
+    object->SetColor(idColor(static_cast<unsigned int>(i + 1)));
+    object->Attributes()->ShadingAspect()->Aspect()->SetShadingModel(
+        Graphic3d_TypeOfShadingModel_Unlit);
+    // Selection mode -1: the selector never sees the id presentations.
+    context->Display(object, AIS_SHADED_MODE, -1, Standard_False);
+    objects.push_back(object);
+  }
+}
+
+void GpuPicker::setPartVisible(size_t part, bool visible) {
+  if (part >= objects.size()) { return; }
+  if (visible) {
+    context->Display(objects[part], AIS_SHADED_MODE, -1, Standard_False);
+  } else {
+    context->Erase(objects[part], Standard_False);
+  }
+}
+
+void GpuPicker::clear() {
+  context->RemoveAll(Standard_False);
+  objects.clear();
+}
+
+int GpuPicker::pick(Graphic3d_Vec2i const &pixel) {
+  if (objects.empty()) { return -1; }
+  TRACE_SCOPE("GpuPicker::pick");
+
+  Graphic3d_Vec2i size;
+  mainView->Window()->Size(size.x(), size.y());
+  if (pixel.x() < 0 || pixel.y() < 0 || pixel.x() >= size.x() ||
+      pixel.y() >= size.y()) {
+    return -1;
+  }
+  window->SetSize(size.x(), size.y());
+
+  Graphic3d_CameraTile tile;
+  tile.TotalSize = size;
+  tile.TileSize = Graphic3d_Vec2i(1, 1);
+  tile.Offset = pixel;
+  tile.IsTopDown = true;
+  view->Camera()->Copy(mainView->Camera());
+  view->Camera()->SetTile(tile);
+  view->Invalidate();
+
+  V3d_ImageDumpOptions options;
+  options.Width = 1;
+  options.Height = 1;
+  options.BufferType = Graphic3d_BT_RGB;
+  // The tile already has the aspect ratio of the whole window.
+  options.ToAdjustAspect = Standard_False;
+  if (!view->ToPixMap(image, options)) { return -1; }
+
+  Standard_Byte const *rgb = image.Data();
+  size_t const id = (size_t(rgb[0]) << 16) | (size_t(rgb[1]) << 8) | rgb[2];
+  // 0 is the background; anything past the last part is not an id.
+  if (id == 0 || id > objects.size()) { return -1; }
+  return int(id - 1);
+}
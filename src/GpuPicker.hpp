@@ -0,0 +1,47 @@
+#ifndef GPUPICKER_HPP
+#define GPUPICKER_HPP
+#include "ModelRegistry.hpp"
+#include <opencascade/AIS_InteractiveContext.hxx>
+#include <opencascade/AIS_Shape.hxx>
+#include <opencascade/Aspect_NeutralWindow.hxx>
+#include <opencascade/Image_PixMap.hxx>
+#include <opencascade/V3d_View.hxx>
+#include <vector>
+
+/**
+ * Picks parts on the GPU: every part is drawn unlit in a color that encodes
+ * its index, into an offscreen target of one pixel whose camera is the
+ * view's camera cut down to the pixel under the cursor, and the pixel is
+ * read back. Unlike the selector, this does not depend on the number of
+ * triangles on the CPU and needs no BVH.
+ *
+ * The id presentations belong to a viewer of their own on the driver of the
+ * view, so that they are only drawn when picking. They take as much GPU
+ * memory as the regular presentations of the parts.
+ */
+class GpuPicker {
+public:
+  /** @param view The view whose camera and window size picks follow. */
+  explicit GpuPicker(Handle(V3d_View) const &view);
+
+  /** Replaces the id presentations; part i is drawn with id i + 1. */
+  void setParts(std::vector<ModelPart> const &parts);
+  void setPartVisible(size_t part, bool visible);
+  void clear();
+
+  /**
+   * @param pixel Window pixel, from the top left corner.
+   * @return The index of the part drawn at the pixel, or -1 for none.
+   */
+  int pick(Graphic3d_Vec2i const &pixel);
+
+private:
+  Handle(V3d_View) mainView;
+  Handle(AIS_InteractiveContext) context;
+  Handle(V3d_View) view;
+  Handle(Aspect_NeutralWindow) window;
+  std::vector<Handle(AIS_Shape)> objects;
+  Image_PixMap image;
+};
+
+#endif // GPUPICKER_HPP
@@ -168,7 +168,8 @@ void drawLoadingScreen(GLuint shaderProgram, SpinnerParams &spinnerParams) {
   }
 }
 
-EMSCRIPTEN_WEBGL_CONTEXT_HANDLE setupWebGLContext(std::string const &canvasId) {
+EMSCRIPTEN_WEBGL_CONTEXT_HANDLE setupWebGLContext(std::string const &canvasId,
+                                                  int majorVersion) {
   EmscriptenWebGLContextAttributes attrs;
   emscripten_webgl_init_context_attributes(&attrs);
 
@@ -180,15 +181,36 @@ EMSCRIPTEN_WEBGL_CONTEXT_HANDLE setupWebGLContext(std::string const &canvasId) {
   attrs.failIfMajorPerformanceCaveat = 0;
   attrs.enableExtensionsByDefault = 1;
   attrs.premultipliedAlpha = 0;
-  attrs.majorVersion = 1;
+  attrs.majorVersion = majorVersion;
   attrs.minorVersion = 0;
 
+  std::string const target = "#" + canvasId;
   EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx =
-      emscripten_webgl_create_context(("#" + canvasId).c_str(), &attrs);
+      emscripten_webgl_create_context(target.c_str(), &attrs);
+  if (ctx <= 0 && majorVersion > 1) {
+    std::cerr << "WebGL " << majorVersion
+              << " is not available, falling back to WebGL 1." << std::endl;
+    attrs.majorVersion = 1;
+    ctx = emscripten_webgl_create_context(target.c_str(), &attrs);
+  }
   emscripten_webgl_make_context_current(ctx);
   return ctx;
 }
 
+int webGLVersion(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx) {
+  EmscriptenWebGLContextAttributes attrs;
+  if (ctx <= 0 ||
+      emscripten_webgl_get_context_attributes(ctx, &attrs) != EMSCRIPTEN_RESULT_SUCCESS) {
+    return 0;
+  }
+  return attrs.majorVersion;
+}
+
+bool enableParallelShaderCompile(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx) {
+  return ctx > 0 &&
+         emscripten_webgl_enable_extension(ctx, "KHR_parallel_shader_compile");
+}
+
 void cleanupWebGLContext(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx) {
   debugOut("cleanupWebGLContext(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx)");
   emscripten_webgl_destroy_context(ctx);
@@ -21,7 +21,23 @@ void drawCheckerBoard(GLuint shaderProgram, Graphic3d_Vec2i windowSize);
 
 void drawLoadingScreen(GLuint shaderProgram, SpinnerParams &spinnerParams);
 
-EMSCRIPTEN_WEBGL_CONTEXT_HANDLE setupWebGLContext(std::string const &canvasId);
+/**
+ * Creates the WebGL context of a canvas and makes it current.
+ *
+ * @param canvasId The id of the canvas element.
+ * @param majorVersion The WebGL version to try first; WebGL 2 falls back to
+ *                     WebGL 1 when the browser does not support it.
+ */
+EMSCRIPTEN_WEBGL_CONTEXT_HANDLE setupWebGLContext(std::string const &canvasId,
+                                                  int majorVersion = 2);
+int webGLVersion(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx);
+/**
+ * Enables KHR_parallel_shader_compile where the browser supports it, so
+ * that it compiles shaders on threads of its own.
+ *
+ * @return Whether the extension is enabled.
+ */
+bool enableParallelShaderCompile(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx);
 void cleanupWebGLContext(EMSCRIPTEN_WEBGL_CONTEXT_HANDLE const &ctx);
 void cleanupShaders(GLuint shaderProgram, const std::vector<GLuint>& shaders);
 void setupViewport(ViewerContext &context);
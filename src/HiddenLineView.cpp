@@ -0,0 +1,226 @@
+#include "HiddenLineView.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+#include <emscripten.h>
+#include <opencascade/Graphic3d_AspectLine3d.hxx>
+#include <opencascade/HLRAlgo_EdgeStatus.hxx>
+#include <opencascade/HLRAlgo_Projector.hxx>
+#include <opencascade/HLRBRep_PolyAlgo.hxx>
+#include <opencascade/Prs3d_Presentation.hxx>
+#include <shared_mutex>
+
+namespace {
+
+// Both line sets of a result, in one object that takes no part in selection.
+class HiddenLines : public AIS_InteractiveObject {
+public:
+  void setLines(Handle(Graphic3d_ArrayOfSegments) const &visibleLines,
+                Handle(Graphic3d_ArrayOfSegments) const &hiddenLines) {
+    visible = visibleLines;
+    hidden = hiddenLines;
+  }
+
+  Standard_Boolean AcceptDisplayMode(Standard_Integer const mode) const override {
+    return mode == 0;
+  }
+
+  void Compute(Handle(PrsMgr_PresentationManager) const &,
+               Handle(Prs3d_Presentation) const &prs,
+               Standard_Integer const) override {
+    if (!hidden.IsNull() && hidden->VertexNumber() > 0) {
+      Handle(Graphic3d_Group) group = prs->NewGroup();
+      group->SetGroupPrimitivesAspect(new Graphic3d_AspectLine3d(
+          Quantity_NOC_GRAY40, Aspect_TOL_DASH, 1.0));
+      group->AddPrimitiveArray(hidden);
+    }
+    if (!visible.IsNull() && visible->VertexNumber() > 0) {
+      Handle(Graphic3d_Group) group = prs->NewGroup();
+      group->SetGroupPrimitivesAspect(new Graphic3d_AspectLine3d(
+          Quantity_NOC_GRAY95, Aspect_TOL_SOLID, 1.5));
+      group->AddPrimitiveArray(visible);
+    }
+  }
+
+  void ComputeSelection(Handle(SelectMgr_Selection) const &,
+                        Standard_Integer const) override {}
+
+private:
+  Handle(Graphic3d_ArrayOfSegments) visible;
+  Handle(Graphic3d_ArrayOfSegments) hidden;
+};
+
+Handle(Graphic3d_ArrayOfSegments) toSegments(std::vector<gp_Pnt> const &points) {
+  Handle(Graphic3d_ArrayOfSegments) segments =
+      new Graphic3d_ArrayOfSegments(int(points.size()));
+  for (gp_Pnt const &point : points) { segments->AddVertex(point); }
+  return segments;
+}
+
+} // namespace
+
+HiddenLineView::HiddenLineView(Handle(AIS_InteractiveContext) const &aisContext,
+                               std::shared_ptr<LoadedModel> const &model)
+    : aisContext(aisContext), model(model), inbox(std::make_shared<Inbox>()),
+      lines(new HiddenLines()) {}
+
+HiddenLineView::~HiddenLineView() { aisContext->Remove(lines, false); }
+
+void HiddenLineView::setShapes(std::vector<TopoDS_Shape> const &shapes) {
+  this->shapes = shapes;
+  ++generation;
+  hide();
+}
+
+void HiddenLineView::setShowHidden(bool value) {
+  if (showHidden == value) { return; }
+  showHidden = value;
+  ++generation;
+  hide();
+}
+
+bool HiddenLineView::update(Handle(V3d_View) const &view) {
+  double const now = emscripten_get_now();
+  bool changed = false;
+
+  Graphic3d_WorldViewProjState const state = view->Camera()->WorldViewProjState();
+  if (!cameraKnown || state.IsChanged(cameraState)) {
+    cameraState = state;
+    cameraKnown = true;
+    stillSince = now;
+    ++generation;
+    changed = hide();
+  }
+
+  std::optional<Result> result;
+  {
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    std::swap(result, inbox->result);
+  }
+  if (result) {
+    inFlight = false;
+    computeTimes.push(result->milliseconds);
+    if (result->generation == generation) {
+      show(*result);
+      changed = true;
+    }
+  }
+
+  // One computation at a time; a stale one is waited for, not piled upon.
+  if (!inFlight && !showing && now - stillSince >= Debounce) { request(view); }
+  return changed;
+}
+
+bool HiddenLineView::isShowing() const { return showing; }
+
+size_t HiddenLineView::segmentCount() const { return segments; }
+
+FrameTimeHistory const &HiddenLineView::getComputeTimes() const {
+  return computeTimes;
+}
+
+void HiddenLineView::request(Handle(V3d_View) const &view) {
+  Handle(Graphic3d_Camera) const &camera = view->Camera();
+
+  // View space has its origin at the camera's center, so that the
+  // projected lines lie on the plane through it, and looks down -Z.
+  gp_Dir const direction = camera->Direction();
+  gp_Ax3 const axes(camera->Center(), direction.Reversed(),
+                    direction.Crossed(camera->Up()));
+  gp_Trsf toView;
+  toView.SetTransformation(axes);
+  HLRAlgo_Projector const projector(toView, !camera->IsOrthographic(),
+                                    camera->Distance());
+  gp_Trsf const toWorld = toView.Inverted();
+
+  inFlight = true;
+  auto model = this->model;
+  auto inbox = this->inbox;
+  auto shapes = this->shapes;
+  unsigned int const generation = this->generation;
+  bool const showHidden = this->showHidden;
+  WorkerPool::submit([model, inbox, shapes, projector, toWorld, generation,
+                      showHidden]() {
+    TRACE_SCOPE("HiddenLineView::compute");
+    double const start = emscripten_get_now();
+    std::vector<gp_Pnt> visible;
+    std::vector<gp_Pnt> hidden;
+    {
+      std::shared_lock<std::shared_mutex> lock(model->triangulationMutex);
+      Handle(HLRBRep_PolyAlgo) algo = new HLRBRep_PolyAlgo();
+      for (TopoDS_Shape const &shape : shapes) { algo->Load(shape); }
+      algo->Projector(projector);
+      algo->Update();
+
+      auto addPart = [&toWorld](std::vector<gp_Pnt> &points, gp_XYZ const &from,
+                                gp_XYZ const &delta, double begin, double end) {
+        gp_XYZ const a = from + delta * begin;
+        gp_XYZ const b = from + delta * end;
+        points.push_back(gp_Pnt(a.X(), a.Y(), 0.0).Transformed(toWorld));
+        points.push_back(gp_Pnt(b.X(), b.Y(), 0.0).Transformed(toWorld));
+      };
+
+      HLRAlgo_EdgeStatus status;
+      TopoDS_Shape shape;
+      Standard_Boolean reg1, regn, outl, intl;
+      for (algo->InitHide(); algo->MoreHide(); algo->NextHide()) {
+        HLRAlgo_BiPoint::PointsT &points =
+            algo->Hide(status, shape, reg1, regn, outl, intl);
+        // Edges between smoothly joined faces are not drawn, unless they
+        // are on the outline.
+        if ((reg1 || regn) && !outl) { continue; }
+
+        gp_XYZ const from(points.PntP1.X(), points.PntP1.Y(), 0.0);
+        gp_XYZ const delta(points.PntP2.X() - points.PntP1.X(),
+                           points.PntP2.Y() - points.PntP1.Y(), 0.0);
+        double first, last;
+        Standard_ShortReal firstTolerance, lastTolerance;
+        status.Bounds(first, firstTolerance, last, lastTolerance);
+
+        // Whatever lies between the visible parts is hidden.
+        double cursor = first;
+        for (int i = 1; i <= status.NbVisiblePart(); ++i) {
+          double partStart, partEnd;
+          Standard_ShortReal startTolerance, endTolerance;
+          status.VisiblePart(i, partStart, startTolerance, partEnd, endTolerance);
+          if (showHidden && partStart > cursor) {
+            addPart(hidden, from, delta, cursor, partStart);
+          }
+          addPart(visible, from, delta, partStart, partEnd);
+          cursor = partEnd;
+        }
+        if (showHidden && last > cursor) {
+          addPart(hidden, from, delta, cursor, last);
+        }
+      }
+    }
+
+    Result result;
+    result.generation = generation;
+    result.visible = toSegments(visible);
+    result.hidden = toSegments(hidden);
+    result.segments = (visible.size() + hidden.size()) / 2;
+    result.milliseconds = emscripten_get_now() - start;
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    inbox->result = std::move(result);
+  });
+}
+
+void HiddenLineView::show(Result const &result) {
+  Handle(HiddenLines)::DownCast(lines)->setLines(result.visible, result.hidden);
+  segments = result.segments;
+  if (aisContext->IsDisplayed(lines)) {
+    aisContext->Redisplay(lines, false);
+  } else {
+    // Erased lines still have the presentation of an older result.
+    lines->SetToUpdate();
+    aisContext->Display(lines, 0, -1, false);
+  }
+  showing = true;
+}
+
+bool HiddenLineView::hide() {
+  if (!showing) { return false; }
+  aisContext->Erase(lines, false);
+  showing = false;
+  return true;
+}
@@ -0,0 +1,93 @@
+#ifndef HIDDENLINEVIEW_HPP
+#define HIDDENLINEVIEW_HPP
+#include "ModelRegistry.hpp"
+#include "ViewerStats.hpp"
+#include <memory>
+#include <mutex>
+#include <opencascade/AIS_InteractiveContext.hxx>
+#include <opencascade/AIS_InteractiveObject.hxx>
+#include <opencascade/Graphic3d_ArrayOfSegments.hxx>
+#include <opencascade/Graphic3d_WorldViewProjState.hxx>
+#include <opencascade/V3d_View.hxx>
+#include <optional>
+#include <vector>
+
+/**
+ * Drawing-style view of a model: the visible, and optionally the hidden,
+ * edges for the current camera, computed by HLRBRep_PolyAlgo from the
+ * triangulations on the worker pool and displayed as line sets.
+ *
+ * A result only holds for the camera it was computed for. Once the camera
+ * moves the lines are erased, and a new result is requested after the
+ * camera was still for Debounce; the owner shows the shaded parts while
+ * isShowing() is false. Results that arrive for an older camera are
+ * dropped.
+ *
+ * Lives on the main thread; update() is called once per frame.
+ */
+class HiddenLineView {
+public:
+  static constexpr double Debounce = 300.0; // ms
+
+  HiddenLineView(Handle(AIS_InteractiveContext) const &aisContext,
+                 std::shared_ptr<LoadedModel> const &model);
+  ~HiddenLineView();
+
+  /** Shapes to compute the lines of; drops the current lines. */
+  void setShapes(std::vector<TopoDS_Shape> const &shapes);
+  /** Whether hidden edges are drawn too, dashed; drops the current lines. */
+  void setShowHidden(bool value);
+
+  /**
+   * Displays a result that arrived for the current camera, erases the
+   * lines if the camera moved and requests a new result once it is still.
+   *
+   * @return Whether the displayed lines changed.
+   */
+  bool update(Handle(V3d_View) const &view);
+
+  /** Whether lines for the current camera are displayed. */
+  bool isShowing() const;
+  size_t segmentCount() const;
+  /** Milliseconds of every HLR computation, on the pool. */
+  FrameTimeHistory const &getComputeTimes() const;
+
+private:
+  struct Result {
+    unsigned int generation = 0;
+    Handle(Graphic3d_ArrayOfSegments) visible;
+    Handle(Graphic3d_ArrayOfSegments) hidden;
+    size_t segments = 0;
+    double milliseconds = 0.0;
+  };
+
+  // Written by the pool, drained by update(). Shared with the job so that
+  // it outlives the view safely.
+  struct Inbox {
+    std::mutex mutex;
+    std::optional<Result> result;
+  };
+
+  Handle(AIS_InteractiveContext) aisContext;
+  std::shared_ptr<LoadedModel> model;
+  std::shared_ptr<Inbox> inbox;
+  std::vector<TopoDS_Shape> shapes;
+  Handle(AIS_InteractiveObject) lines;
+  bool showHidden = false;
+
+  Graphic3d_WorldViewProjState cameraState;
+  bool cameraKnown = false;
+  double stillSince = 0.0;
+  // Bumped whenever the lines on display, or in flight, become stale.
+  unsigned int generation = 0;
+  bool inFlight = false;
+  bool showing = false;
+  size_t segments = 0;
+  FrameTimeHistory computeTimes;
+
+  void request(Handle(V3d_View) const &view);
+  void show(Result const &result);
+  bool hide();
+};
+
+#endif // HIDDENLINEVIEW_HPP
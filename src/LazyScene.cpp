@@ -0,0 +1,279 @@
+#include "LazyScene.hpp"
+#include "MemoryProfiler.hpp"
+#include "OCCTUtilities.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+#include "staircase.hpp"
+#include <algorithm>
+#include <opencascade/BRepTools.hxx>
+#include <opencascade/Graphic3d_ArrayOfSegments.hxx>
+#include <opencascade/Graphic3d_AspectLine3d.hxx>
+#include <opencascade/Prs3d_Presentation.hxx>
+#include <opencascade/XCAFPrs_AISObject.hxx>
+
+namespace {
+
+size_t const MaxUnloadsPerFrame = 4;
+
+// Draws the boxes of all branches that are not displayed, as one primitive
+// array, so that a model with thousands of branches stays a single object.
+class BranchPlaceholders : public AIS_InteractiveObject {
+public:
+  BranchPlaceholders(std::vector<Bnd_Box> const &boxes) : boxes(boxes) {}
+
+  std::vector<Bnd_Box> &changeBoxes() { return boxes; }
+
+  Standard_Boolean AcceptDisplayMode(Standard_Integer const mode) const override {
+    return mode == 0;
+  }
+
+  void Compute(Handle(PrsMgr_PresentationManager) const &,
+               Handle(Prs3d_Presentation) const &prs,
+               Standard_Integer const) override {
+    size_t count = 0;
+    for (auto const &box : boxes) {
+      count += box.IsVoid() ? 0 : 1;
+    }
+    if (count == 0) { return; }
+
+    Handle(Graphic3d_ArrayOfSegments) segments =
+        new Graphic3d_ArrayOfSegments(int(count * 8), int(count * 24));
+    for (auto const &box : boxes) {
+      if (box.IsVoid()) { continue; }
+
+      gp_Pnt const lo = box.CornerMin();
+      gp_Pnt const hi = box.CornerMax();
+      int const first = segments->VertexNumber() + 1;
+      for (int corner = 0; corner < 8; ++corner) {
+        segments->AddVertex((corner & 1) ? hi.X() : lo.X(),
+                            (corner & 2) ? hi.Y() : lo.Y(),
+                            (corner & 4) ? hi.Z() : lo.Z());
+      }
+      // The 12 edges join corners that differ in exactly one coordinate.
+      for (int corner = 0; corner < 8; ++corner) {
+        for (int bit = 1; bit < 8; bit <<= 1) {
+          if (!(corner & bit)) {
+            segments->AddEdges(first + corner, first + (corner | bit));
+          }
+        }
+      }
+    }
+
+    Handle(Graphic3d_Group) group = prs->NewGroup();
+    group->SetGroupPrimitivesAspect(new Graphic3d_AspectLine3d(
+        Quantity_NOC_GRAY50, Aspect_TOL_DASH, 1.0));
+    group->AddPrimitiveArray(segments);
+  }
+
+  void ComputeSelection(Handle(SelectMgr_Selection) const &,
+                        Standard_Integer const) override {}
+
+private:
+  std::vector<Bnd_Box> boxes;
+};
+
+} // namespace
+
+LazyScene::LazyScene(Handle(AIS_InteractiveContext) const &aisContext,
+                     std::shared_ptr<LoadedModel> const &model)
+    : aisContext(aisContext), model(model),
+      source(&model->attached<LazyBranches>()),
+      inbox(std::make_shared<Inbox>()), branches(source->branches.size()) {
+  bounds.reserve(source->branches.size());
+  for (auto const &branch : source->branches) {
+    bounds.push_back(branch.box);
+  }
+  placeholders = new BranchPlaceholders(bounds);
+  aisContext->Display(placeholders, 0, -1, false);
+}
+
+LazyScene::~LazyScene() {
+  for (size_t i = 0; i < branches.size(); ++i) {
+    if (!branches[i].presentation.IsNull()) {
+      aisContext->Remove(branches[i].presentation, false);
+    }
+    if (branches[i].state != BranchState::Placeholder) { releaseGroup(i); }
+  }
+  aisContext->Remove(placeholders, false);
+}
+
+bool LazyScene::update(Handle(V3d_View) const &view) {
+  TRACE_SCOPE("LazyScene::update");
+  ++frame;
+
+  std::vector<size_t> meshed;
+  {
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    std::swap(meshed, inbox->meshed);
+  }
+  for (size_t index : meshed) {
+    --inFlight;
+    BranchView &branch = branches[index];
+    if (branch.state != BranchState::Meshing) { continue; }
+    if (branch.collapsed) {
+      branch.state = BranchState::Placeholder;
+      releaseGroup(index);
+    } else {
+      showBranch(index);
+    }
+  }
+
+  markVisible(view);
+  unloadUnderPressure();
+
+  bool const changed = placeholdersChanged;
+  if (placeholdersChanged) {
+    aisContext->Redisplay(placeholders, false);
+    placeholdersChanged = false;
+  }
+  return changed;
+}
+
+void LazyScene::expand(size_t branch) {
+  if (branch >= branches.size()) { return; }
+
+  // A branch that is still meshing is shown when its mesh arrives.
+  branches[branch].collapsed = false;
+  branches[branch].lastVisibleFrame = frame;
+  if (branches[branch].state == BranchState::Placeholder) { requestMesh(branch); }
+}
+
+void LazyScene::collapse(size_t branch) {
+  if (branch >= branches.size()) { return; }
+
+  // Stays a placeholder while in view, until it is expanded again.
+  branches[branch].collapsed = true;
+  if (branches[branch].state == BranchState::Loaded) { unloadBranch(branch); }
+}
+
+void LazyScene::setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+
+size_t LazyScene::branchCount() const { return branches.size(); }
+
+size_t LazyScene::loadedCount() const { return loaded; }
+
+size_t LazyScene::pendingCount() const { return inFlight; }
+
+MeshScheduler const &LazyScene::getScheduler() const { return scheduler; }
+
+void LazyScene::requestMesh(size_t index) {
+  branches[index].state = BranchState::Meshing;
+  ++inFlight;
+  ++source->groupUsers[source->branches[index].group];
+
+  auto model = this->model;
+  auto source = this->source;
+  auto inbox = this->inbox;
+  WorkerPool::submit([model, source, inbox, index]() {
+    {
+      std::shared_lock<std::shared_mutex> lock(model->triangulationMutex);
+      std::lock_guard<std::mutex> groupLock(
+          *source->groupMutexes[source->branches[index].group]);
+      meshShape(source->branches[index].shape);
+    }
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    inbox->meshed.push_back(index);
+  });
+}
+
+void LazyScene::showBranch(size_t index) {
+  TRACE_SCOPE("LazyScene::showBranch");
+  BranchView &branch = branches[index];
+
+  // Picks up the colors, names and nested structure of the branch label.
+  branch.presentation = new XCAFPrs_AISObject(source->branches[index].label);
+  aisContext->Display(branch.presentation, AIS_SHADED_MODE, 0, false);
+  branch.state = BranchState::Loaded;
+  ++loaded;
+  scheduler.markFinal(index);
+
+  auto placeholderBoxes = Handle(BranchPlaceholders)::DownCast(placeholders);
+  placeholderBoxes->changeBoxes()[index].SetVoid();
+  placeholdersChanged = true;
+}
+
+void LazyScene::unloadBranch(size_t index) {
+  BranchView &branch = branches[index];
+  aisContext->Remove(branch.presentation, false);
+  branch.presentation.Nullify();
+  branch.state = BranchState::Placeholder;
+  --loaded;
+  scheduler.markNotFinal(index);
+  releaseGroup(index);
+
+  auto placeholderBoxes = Handle(BranchPlaceholders)::DownCast(placeholders);
+  placeholderBoxes->changeBoxes()[index] = source->branches[index].box;
+  placeholdersChanged = true;
+}
+
+void LazyScene::releaseGroup(size_t index) {
+  size_t const group = source->branches[index].group;
+  if (--source->groupUsers[group] > 0) { return; }
+
+  // Skipped while jobs of this or another viewer mesh the same model; the
+  // triangulations are then reused when the group is meshed again.
+  std::unique_lock<std::shared_mutex> lock(model->triangulationMutex,
+                                           std::try_to_lock);
+  if (!lock.owns_lock()) { return; }
+  for (ModelBranch const &branch : source->branches) {
+    if (branch.group == group) { BRepTools::Clean(branch.shape); }
+  }
+}
+
+void LazyScene::markVisible(Handle(V3d_View) const &view) {
+  Handle(Graphic3d_Camera) camera = view->Camera();
+  bool const moved =
+      !cameraKnown || camera->WorldViewProjState().IsChanged(cameraState);
+  if (moved) {
+    cameraState = camera->WorldViewProjState();
+    cameraKnown = true;
+
+    Standard_Integer width = 0, height = 0;
+    view->Window()->Size(width, height);
+    scheduler.rank(camera, width, height, bounds, [this](size_t i) {
+      return branches[i].state == BranchState::Loaded;
+    });
+    for (size_t i = 0; i < branches.size(); ++i) {
+      if (scheduler.isVisible(i)) { branches[i].lastVisibleFrame = frame; }
+    }
+  }
+
+  // Tiny branches wait until the camera stops, so that orbiting does not
+  // spend the pool on parts that cover a few pixels.
+  size_t const maxInFlight = 2 * WorkerPool::size();
+  auto isWaiting = [this](size_t i) {
+    return branches[i].state == BranchState::Placeholder &&
+           !branches[i].collapsed;
+  };
+  while (inFlight < maxInFlight) {
+    std::optional<size_t> branch = scheduler.next(isWaiting, !moved);
+    if (!branch) { break; }
+    requestMesh(*branch);
+  }
+}
+
+void LazyScene::unloadUnderPressure() {
+  if (memoryBudget == 0 || loaded == 0 ||
+      MemoryProfiler::snapshot().inUse <= memoryBudget) {
+    return;
+  }
+
+  std::vector<size_t> hidden;
+  for (size_t i = 0; i < branches.size(); ++i) {
+    if (branches[i].state == BranchState::Loaded &&
+        !scheduler.isVisible(i)) {
+      hidden.push_back(i);
+    }
+  }
+  if (hidden.empty()) { return; }
+
+  size_t const count = std::min(hidden.size(), MaxUnloadsPerFrame);
+  std::partial_sort(hidden.begin(), hidden.begin() + count, hidden.end(),
+                    [this](size_t a, size_t b) {
+                      return branches[a].lastVisibleFrame <
+                             branches[b].lastVisibleFrame;
+                    });
+  for (size_t i = 0; i < count; ++i) {
+    unloadBranch(hidden[i]);
+  }
+}
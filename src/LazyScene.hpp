@@ -0,0 +1,122 @@
+#ifndef LAZYSCENE_HPP
+#define LAZYSCENE_HPP
+#include "MeshScheduler.hpp"
+#include "ModelRegistry.hpp"
+#include <memory>
+#include <mutex>
+#include <opencascade/AIS_InteractiveContext.hxx>
+#include <opencascade/AIS_InteractiveObject.hxx>
+#include <opencascade/Bnd_Box.hxx>
+#include <opencascade/Graphic3d_WorldViewProjState.hxx>
+#include <opencascade/TDF_Label.hxx>
+#include <opencascade/V3d_View.hxx>
+#include <vector>
+
+// A top-level product, or a component of a top-level assembly, that lazy
+// mode meshes and displays on its own.
+struct ModelBranch {
+  TDF_Label label;
+  TopoDS_Shape shape;
+  Bnd_Box box;
+  // Branches that share a face are in the same mesh group.
+  size_t group = 0;
+};
+
+/**
+ * The branches of a lazy model, attached to it by buildLazyModel() and
+ * shared by the scenes of all viewers that show it.
+ */
+struct LazyBranches {
+  std::vector<ModelBranch> branches;
+  // One thread at a time meshes the branches of a group, so that shared
+  // faces are never meshed twice at once.
+  std::vector<std::unique_ptr<std::mutex>> groupMutexes;
+  // Displayed or meshing branches of every group, over all viewers. A
+  // group's triangulations are dropped only once it has none. Main thread
+  // only.
+  std::vector<unsigned int> groupUsers;
+};
+
+/**
+ * Displays a lazy model: every branch starts as a placeholder box, and is
+ * meshed on the worker pool and displayed once it enters the view or is
+ * expanded. Branches in view are meshed largest on screen first. Branches
+ * that left the view are unloaded again, least recently seen first, while
+ * the heap is above the memory budget.
+ *
+ * Lives on the main thread; update() is called once per frame.
+ */
+class LazyScene {
+public:
+  LazyScene(Handle(AIS_InteractiveContext) const &aisContext,
+            std::shared_ptr<LoadedModel> const &model);
+  ~LazyScene();
+
+  /**
+   * Displays the branches that finished meshing, requests the ones in view
+   * and unloads under memory pressure.
+   *
+   * @param view The view whose camera decides which branches are visible.
+   * @return Whether the displayed objects changed.
+   */
+  bool update(Handle(V3d_View) const &view);
+
+  void expand(size_t branch);
+  /** A branch that is still meshing is not shown when its mesh arrives. */
+  void collapse(size_t branch);
+
+  /**
+   * @param bytes Heap bytes in use above which hidden branches are unloaded,
+   *              0 to never unload.
+   */
+  void setMemoryBudget(size_t bytes);
+
+  size_t branchCount() const;
+  size_t loadedCount() const;
+  size_t pendingCount() const;
+  MeshScheduler const &getScheduler() const;
+
+private:
+  enum class BranchState { Placeholder, Meshing, Loaded };
+
+  struct BranchView {
+    BranchState state = BranchState::Placeholder;
+    Handle(AIS_InteractiveObject) presentation;
+    unsigned int lastVisibleFrame = 0;
+    bool collapsed = false;
+  };
+
+  // Written by pool threads, drained by update(). Shared with the jobs so
+  // that they outlive the scene safely.
+  struct Inbox {
+    std::mutex mutex;
+    std::vector<size_t> meshed;
+  };
+
+  Handle(AIS_InteractiveContext) aisContext;
+  std::shared_ptr<LoadedModel> model;
+  // Attached to model, which keeps it alive.
+  LazyBranches *source;
+  std::shared_ptr<Inbox> inbox;
+  std::vector<BranchView> branches;
+  std::vector<Bnd_Box> bounds;
+  MeshScheduler scheduler;
+  Handle(AIS_InteractiveObject) placeholders;
+
+  Graphic3d_WorldViewProjState cameraState;
+  bool cameraKnown = false;
+  unsigned int frame = 0;
+  size_t inFlight = 0;
+  size_t loaded = 0;
+  size_t memoryBudget = 0;
+  bool placeholdersChanged = false;
+
+  void requestMesh(size_t branch);
+  void showBranch(size_t branch);
+  void unloadBranch(size_t branch);
+  void releaseGroup(size_t branch);
+  void markVisible(Handle(V3d_View) const &view);
+  void unloadUnderPressure();
+};
+
+#endif // LAZYSCENE_HPP
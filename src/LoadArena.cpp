@@ -0,0 +1,152 @@
+#include "LoadArena.hpp"
+#include <atomic>
+#include <emscripten/heap.h>
+
+namespace LoadArena {
+
+#ifdef LOAD_ARENA
+namespace {
+
+size_t const ChunkShift = 20;
+size_t const ChunkSize = size_t(1) << ChunkShift;
+size_t const MaxBlockSize = 4096;
+size_t const Alignment = 16;
+size_t const HeaderSize = Alignment; // keeps blocks 16-byte aligned
+
+struct Chunk {
+  // One reference per live block, plus one while the chunk is still the
+  // bump target of its thread.
+  std::atomic<uint32_t> live;
+  size_t used;
+};
+
+size_t const FirstBlockOffset = (sizeof(Chunk) + Alignment - 1) & ~(Alignment - 1);
+
+// One flag per possible chunk in a 4 GiB wasm32 address space, so owns() is a
+// single lookup without locking.
+std::atomic<bool> chunkTable[size_t(1) << (32 - ChunkShift)];
+
+std::atomic<bool> enabled{true};
+std::atomic<uint64_t> chunksAllocated{0};
+std::atomic<uint64_t> chunksReleased{0};
+std::atomic<uint64_t> blocksAllocated{0};
+std::atomic<uint64_t> bytesAllocated{0};
+
+thread_local bool scopeOpen = false;
+thread_local Chunk *currentChunk = nullptr;
+
+size_t chunkIndex(void const *ptr) {
+  return reinterpret_cast<uintptr_t>(ptr) >> ChunkShift;
+}
+
+Chunk *chunkOf(void const *ptr) {
+  return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(ptr) &
+                                   ~(uintptr_t(ChunkSize) - 1));
+}
+
+void unref(Chunk *chunk) {
+  if (chunk->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    chunkTable[chunkIndex(chunk)].store(false, std::memory_order_release);
+    chunksReleased.fetch_add(1, std::memory_order_relaxed);
+    emscripten_builtin_free(chunk);
+  }
+}
+
+void retireCurrentChunk() {
+  if (currentChunk) {
+    unref(currentChunk);
+    currentChunk = nullptr;
+  }
+}
+
+Chunk *newChunk() {
+  void *memory = emscripten_builtin_memalign(ChunkSize, ChunkSize);
+  if (!memory) { return nullptr; }
+
+  auto chunk = static_cast<Chunk *>(memory);
+  chunk->live.store(1, std::memory_order_relaxed);
+  chunk->used = FirstBlockOffset;
+  chunkTable[chunkIndex(chunk)].store(true, std::memory_order_release);
+  chunksAllocated.fetch_add(1, std::memory_order_relaxed);
+  return chunk;
+}
+
+} // namespace
+
+bool isAvailable() { return true; }
+
+size_t chunkSize() { return ChunkSize; }
+
+void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+Stats stats() {
+  Stats result;
+  result.chunksAllocated = chunksAllocated.load(std::memory_order_relaxed);
+  result.chunksReleased = chunksReleased.load(std::memory_order_relaxed);
+  result.blocksAllocated = blocksAllocated.load(std::memory_order_relaxed);
+  result.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+  return result;
+}
+
+void *allocate(size_t size) {
+  if (!scopeOpen || size > MaxBlockSize) { return nullptr; }
+
+  size_t const blockSize =
+      HeaderSize + ((size + Alignment - 1) & ~(Alignment - 1));
+  if (!currentChunk || currentChunk->used + blockSize > ChunkSize) {
+    retireCurrentChunk();
+    currentChunk = newChunk();
+    if (!currentChunk) { return nullptr; }
+  }
+
+  auto base = reinterpret_cast<char *>(currentChunk) + currentChunk->used;
+  currentChunk->used += blockSize;
+  currentChunk->live.fetch_add(1, std::memory_order_relaxed);
+  *reinterpret_cast<size_t *>(base) = blockSize - HeaderSize;
+
+  blocksAllocated.fetch_add(1, std::memory_order_relaxed);
+  bytesAllocated.fetch_add(blockSize, std::memory_order_relaxed);
+  return base + HeaderSize;
+}
+
+bool owns(void const *ptr) {
+  return ptr && chunkTable[chunkIndex(ptr)].load(std::memory_order_acquire);
+}
+
+void release(void *ptr) { unref(chunkOf(ptr)); }
+
+size_t usableSize(void const *ptr) {
+  return *reinterpret_cast<size_t const *>(static_cast<char const *>(ptr) -
+                                           HeaderSize);
+}
+
+Scope::Scope() : active(isEnabled() && !scopeOpen) {
+  if (active) { scopeOpen = true; }
+}
+
+Scope::~Scope() {
+  if (active) {
+    scopeOpen = false;
+    retireCurrentChunk();
+  }
+}
+
+#else
+
+bool isAvailable() { return false; }
+size_t chunkSize() { return 0; }
+void setEnabled(bool) {}
+bool isEnabled() { return false; }
+Stats stats() { return Stats(); }
+void *allocate(size_t) { return nullptr; }
+bool owns(void const *) { return false; }
+void release(void *) {}
+size_t usableSize(void const *) { return 0; }
+Scope::Scope() : active(false) {}
+Scope::~Scope() {}
+
+#endif
+
+} // namespace LoadArena
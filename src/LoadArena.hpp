@@ -0,0 +1,59 @@
+#ifndef LOADARENA_HPP
+#define LOADARENA_HPP
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Region allocator for the transient objects the STEP reader creates.
+ *
+ * While a Scope is open on a thread, small allocations made by that thread
+ * are bump-allocated from 1 MiB chunks instead of the general heap. A chunk
+ * goes back to the heap as a whole once every block in it has been freed, so
+ * the millions of StepData and Interface entities released together with the
+ * reader leave no holes behind. A block that outlives the reader keeps its
+ * whole chunk alive, which fragments the heap rather than helping; only
+ * reading is done in a scope, so that the shapes kept in the document are
+ * allocated outside it, and loads report the chunks that survive them.
+ *
+ * Only compiled in with LOAD_ARENA, which routes malloc and free through the
+ * hooks in MemoryProfiler.cpp.
+ */
+namespace LoadArena {
+
+struct Stats {
+  uint64_t chunksAllocated = 0;
+  uint64_t chunksReleased = 0;
+  uint64_t blocksAllocated = 0;
+  uint64_t bytesAllocated = 0;
+};
+
+/** Chunk size in bytes; every live chunk holds this much heap. */
+size_t chunkSize();
+
+bool isAvailable();
+void setEnabled(bool value);
+bool isEnabled();
+Stats stats();
+
+// Allocator hooks. allocate() returns nullptr when no scope is open on the
+// calling thread or the request is too large for a chunk.
+void *allocate(size_t size);
+bool owns(void const *ptr);
+void release(void *ptr);
+size_t usableSize(void const *ptr);
+
+class Scope {
+public:
+  Scope();
+  ~Scope();
+
+  Scope(Scope const &) = delete;
+  Scope &operator=(Scope const &) = delete;
+
+private:
+  bool active;
+};
+
+} // namespace LoadArena
+
+#endif // LOADARENA_HPP
@@ -0,0 +1,117 @@
+#include "MemoryProfiler.hpp"
+#include "LoadArena.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <emscripten/heap.h>
+#include <malloc.h>
+
+#if defined(MEMORY_PROFILING) || defined(LOAD_ARENA)
+#define MALLOC_HOOKS
+#endif
+
+#ifdef MALLOC_HOOKS
+namespace {
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocationBytes{0};
+
+size_t usableSize(void const *ptr) {
+  return LoadArena::owns(ptr) ? LoadArena::usableSize(ptr)
+                              : malloc_usable_size(const_cast<void *>(ptr));
+}
+
+void *recordAllocation(void *ptr) {
+  if (ptr) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(usableSize(ptr), std::memory_order_relaxed);
+  }
+  return ptr;
+}
+} // namespace
+
+// Replacements for the libc allocator entry points. They forward to the load
+// arena or to the dlmalloc implementation through the emscripten_builtin_*
+// aliases, and must not allocate themselves.
+extern "C" {
+void *malloc(size_t size) {
+  if (void *ptr = LoadArena::allocate(size)) { return recordAllocation(ptr); }
+  return recordAllocation(emscripten_builtin_malloc(size));
+}
+
+void free(void *ptr) {
+  if (LoadArena::owns(ptr)) {
+    LoadArena::release(ptr);
+    return;
+  }
+  emscripten_builtin_free(ptr);
+}
+
+void *calloc(size_t count, size_t size) {
+  if (size != 0 && count > SIZE_MAX / size) { return nullptr; }
+  void *ptr = malloc(count * size);
+  if (ptr) { std::memset(ptr, 0, count * size); }
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (!ptr) { return malloc(size); }
+  if (size == 0) {
+    free(ptr);
+    return nullptr;
+  }
+  size_t const usable = usableSize(ptr);
+  if (size <= usable) { return ptr; }
+
+  void *newPtr = malloc(size);
+  if (newPtr) {
+    std::memcpy(newPtr, ptr, usable);
+    free(ptr);
+  }
+  return newPtr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  return recordAllocation(emscripten_builtin_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) {
+  void *ptr = memalign(alignment, size);
+  if (!ptr) { return ENOMEM; }
+  *result = ptr;
+  return 0;
+}
+}
+#endif
+
+namespace MemoryProfiler {
+
+bool isCountingAllocations() {
+#ifdef MALLOC_HOOKS
+  return true;
+#else
+  return false;
+#endif
+}
+
+HeapSnapshot snapshot() {
+  struct mallinfo info = mallinfo();
+
+  HeapSnapshot result;
+  result.heapSize = emscripten_get_heap_size();
+  result.peakFootprint = static_cast<size_t>(info.usmblks);
+  result.inUse = static_cast<size_t>(info.uordblks);
+  result.footprint = static_cast<size_t>(info.arena);
+  result.freeBytes = static_cast<size_t>(info.fordblks);
+#ifdef MALLOC_HOOKS
+  result.allocations = allocationCount.load(std::memory_order_relaxed);
+  result.allocatedBytes = allocationBytes.load(std::memory_order_relaxed);
+#endif
+  return result;
+}
+
+} // namespace MemoryProfiler
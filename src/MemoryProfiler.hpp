@@ -0,0 +1,28 @@
+#ifndef MEMORYPROFILER_HPP
+#define MEMORYPROFILER_HPP
+#include <cstddef>
+#include <cstdint>
+
+struct HeapSnapshot {
+  size_t heapSize = 0;      // wasm memory size, grows with ALLOW_MEMORY_GROWTH
+  size_t peakFootprint = 0; // high-water mark of memory obtained by malloc
+  size_t inUse = 0;         // bytes currently allocated
+  size_t footprint = 0;     // memory currently obtained by malloc
+  size_t freeBytes = 0;     // free space inside the footprint (fragmentation)
+  uint64_t allocations = 0;
+  uint64_t allocatedBytes = 0;
+};
+
+/**
+ * Heap instrumentation. Heap size, in-use bytes and the malloc high-water
+ * mark are always available. Allocation counts and byte totals are only
+ * collected when built with MEMORY_PROFILING or LOAD_ARENA, which hook
+ * malloc; they cover every thread, including OCCT's Standard::Allocate, which
+ * forwards to malloc.
+ */
+namespace MemoryProfiler {
+bool isCountingAllocations();
+HeapSnapshot snapshot();
+} // namespace MemoryProfiler
+
+#endif // MEMORYPROFILER_HPP
@@ -0,0 +1,233 @@
+#include "MeshOptimizer.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencascade/BRep_CurveRepresentation.hxx>
+#include <opencascade/BRep_ListIteratorOfListOfCurveRepresentation.hxx>
+#include <opencascade/BRep_TEdge.hxx>
+#include <opencascade/Poly_PolygonOnTriangulation.hxx>
+#include <opencascade/TopExp_Explorer.hxx>
+#include <opencascade/TopoDS.hxx>
+#include <unordered_set>
+#include <vector>
+
+std::atomic<size_t> MeshOptimizer::minTriangles{4096};
+std::atomic<size_t> MeshOptimizer::optimized{0};
+std::atomic<size_t> MeshOptimizer::triangles{0};
+std::atomic<size_t> MeshOptimizer::before{0};
+std::atomic<size_t> MeshOptimizer::after{0};
+
+namespace {
+
+// Scoring constants from Forsyth, "Linear-Speed Vertex Cache Optimisation".
+float vertexScore(int cachePosition, int remaining) {
+  if (remaining == 0) { return -1.0f; }
+
+  float score = 0.0f;
+  if (cachePosition >= 0 && cachePosition < 3) {
+    // The last triangle's vertices score lower, so strips do not run on.
+    score = 0.75f;
+  } else if (cachePosition >= 3) {
+    float const scale = 1.0f / (MeshOptimizer::CacheSize - 3);
+    score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+  }
+  // Favours vertices with few triangles left, to finish them off.
+  return score + 2.0f / std::sqrt(float(remaining));
+}
+
+size_t fifoMisses(std::vector<int> const &indices, int vertexCount) {
+  std::vector<size_t> insertedAt(vertexCount, std::numeric_limits<size_t>::max());
+  size_t misses = 0;
+  for (int v : indices) {
+    if (insertedAt[v] == std::numeric_limits<size_t>::max() ||
+        misses - insertedAt[v] >= size_t(MeshOptimizer::FifoSize)) {
+      insertedAt[v] = misses++;
+    }
+  }
+  return misses;
+}
+
+std::vector<int> forsythOrder(std::vector<int> const &indices, int vertexCount) {
+  int const triangleCount = int(indices.size() / 3);
+
+  // Triangles per vertex; the live ones are kept at the front of each list.
+  std::vector<int> remaining(vertexCount, 0);
+  for (int v : indices) { ++remaining[v]; }
+  std::vector<int> offsets(vertexCount + 1, 0);
+  for (int v = 0; v < vertexCount; ++v) { offsets[v + 1] = offsets[v] + remaining[v]; }
+  std::vector<int> adjacency(indices.size());
+  {
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacency[fill[indices[i]]++] = int(i / 3);
+    }
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> scores(vertexCount);
+  for (int v = 0; v < vertexCount; ++v) { scores[v] = vertexScore(-1, remaining[v]); }
+  std::vector<float> triangleScores(triangleCount);
+  for (int t = 0; t < triangleCount; ++t) {
+    triangleScores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] +
+                        scores[indices[3 * t + 2]];
+  }
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<int> cache;
+  std::vector<int> nextCache;
+  std::vector<int> result;
+  result.reserve(indices.size());
+  int best = int(std::max_element(triangleScores.begin(), triangleScores.end()) -
+                 triangleScores.begin());
+  int scan = 0;
+  while (best >= 0) {
+    emitted[best] = true;
+    nextCache.clear();
+    for (int k = 0; k < 3; ++k) {
+      int const v = indices[3 * best + k];
+      result.push_back(v);
+      nextCache.push_back(v);
+
+      int *live = &adjacency[offsets[v]];
+      std::swap(*std::find(live, live + remaining[v], best), live[remaining[v] - 1]);
+      --remaining[v];
+    }
+    for (int v : cache) {
+      if (std::find(nextCache.begin(), nextCache.begin() + 3, v) ==
+          nextCache.begin() + 3) {
+        nextCache.push_back(v);
+      }
+    }
+
+    // Vertices pushed out of the cache are rescored along with the rest.
+    for (size_t i = 0; i < nextCache.size(); ++i) {
+      int const v = nextCache[i];
+      cachePosition[v] = i < size_t(MeshOptimizer::CacheSize) ? int(i) : -1;
+      scores[v] = vertexScore(cachePosition[v], remaining[v]);
+    }
+
+    best = -1;
+    float bestScore = -1.0f;
+    for (int v : nextCache) {
+      for (int k = offsets[v]; k < offsets[v] + remaining[v]; ++k) {
+        int const t = adjacency[k];
+        float const score = scores[indices[3 * t]] + scores[indices[3 * t + 1]] +
+                            scores[indices[3 * t + 2]];
+        triangleScores[t] = score;
+        if (cachePosition[v] >= 0 && score > bestScore) {
+          best = t;
+          bestScore = score;
+        }
+      }
+    }
+    if (nextCache.size() > size_t(MeshOptimizer::CacheSize)) {
+      nextCache.resize(MeshOptimizer::CacheSize);
+    }
+    cache.swap(nextCache);
+
+    // Nothing in the cache has triangles left: continue elsewhere.
+    if (best < 0) {
+      while (scan < triangleCount && emitted[scan]) { ++scan; }
+      if (scan < triangleCount) { best = scan; }
+    }
+  }
+  return result;
+}
+
+void remapPolygon(Handle(Poly_PolygonOnTriangulation) const &polygon,
+                  std::vector<int> const &remap) {
+  if (polygon.IsNull()) { return; }
+  for (int i = 1; i <= polygon->NbNodes(); ++i) {
+    polygon->SetNode(i, remap[polygon->Node(i) - 1] + 1);
+  }
+}
+
+} // namespace
+
+void MeshOptimizer::setMinPartTriangles(size_t count) { minTriangles = count; }
+
+size_t MeshOptimizer::minPartTriangles() { return minTriangles; }
+
+void MeshOptimizer::optimize(TopoDS_Face const &face,
+                             Handle(Poly_Triangulation) const &triangulation) {
+  TRACE_SCOPE("MeshOptimizer::optimize");
+  int const vertexCount = triangulation->NbNodes();
+  int const triangleCount = triangulation->NbTriangles();
+  if (triangleCount < 2) { return; }
+
+  std::vector<int> indices(3 * size_t(triangleCount));
+  for (int t = 0; t < triangleCount; ++t) {
+    int a, b, c;
+    triangulation->Triangle(t + 1).Get(a, b, c);
+    if (a == b || b == c || a == c) { return; }
+    indices[3 * t] = a - 1;
+    indices[3 * t + 1] = b - 1;
+    indices[3 * t + 2] = c - 1;
+  }
+  size_t const missesBefore = fifoMisses(indices, vertexCount);
+  indices = forsythOrder(indices, vertexCount);
+
+  // New node numbers in order of first use; unused nodes go last.
+  std::vector<int> remap(vertexCount, -1);
+  int next = 0;
+  for (int &v : indices) {
+    if (remap[v] < 0) { remap[v] = next++; }
+    v = remap[v];
+  }
+  for (int &target : remap) {
+    if (target < 0) { target = next++; }
+  }
+
+  std::vector<gp_Pnt> nodes(vertexCount);
+  std::vector<gp_Pnt2d> uvs(triangulation->HasUVNodes() ? vertexCount : 0);
+  std::vector<gp_Vec3f> normals(triangulation->HasNormals() ? vertexCount : 0);
+  for (int v = 0; v < vertexCount; ++v) {
+    nodes[v] = triangulation->Node(v + 1);
+    if (!uvs.empty()) { uvs[v] = triangulation->UVNode(v + 1); }
+    if (!normals.empty()) { triangulation->Normal(v + 1, normals[v]); }
+  }
+  for (int v = 0; v < vertexCount; ++v) {
+    triangulation->SetNode(remap[v] + 1, nodes[v]);
+    if (!uvs.empty()) { triangulation->SetUVNode(remap[v] + 1, uvs[v]); }
+    if (!normals.empty()) { triangulation->SetNormal(remap[v] + 1, normals[v]); }
+  }
+  for (int t = 0; t < triangleCount; ++t) {
+    triangulation->SetTriangle(
+        t + 1, Poly_Triangle(indices[3 * t] + 1, indices[3 * t + 1] + 1,
+                             indices[3 * t + 2] + 1));
+  }
+
+  // Seam edges are visited twice but hold both of their polygons at once.
+  std::unordered_set<BRep_CurveRepresentation const *> visited;
+  for (TopExp_Explorer exp(face, TopAbs_EDGE); exp.More(); exp.Next()) {
+    auto edge = Handle(BRep_TEdge)::DownCast(exp.Current().TShape());
+    if (edge.IsNull()) { continue; }
+    for (BRep_ListIteratorOfListOfCurveRepresentation it(edge->Curves());
+         it.More(); it.Next()) {
+      Handle(BRep_CurveRepresentation) const &curve = it.Value();
+      if (!curve->IsPolygonOnTriangulation() ||
+          curve->Triangulation() != triangulation ||
+          !visited.insert(curve.get()).second) {
+        continue;
+      }
+      remapPolygon(curve->PolygonOnTriangulation(), remap);
+      if (curve->IsPolygonOnClosedTriangulation()) {
+        remapPolygon(curve->PolygonOnTriangulation2(), remap);
+      }
+    }
+  }
+
+  ++optimized;
+  triangles += triangleCount;
+  before += missesBefore;
+  after += fifoMisses(indices, vertexCount);
+}
+
+size_t MeshOptimizer::optimizedCount() { return optimized; }
+
+size_t MeshOptimizer::triangleCount() { return triangles; }
+
+size_t MeshOptimizer::invocationsBefore() { return before; }
+
+size_t MeshOptimizer::invocationsAfter() { return after; }
@@ -0,0 +1,54 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+#include <atomic>
+#include <cstddef>
+#include <opencascade/Poly_Triangulation.hxx>
+#include <opencascade/TopoDS_Face.hxx>
+
+/**
+ * Reorders freshly meshed triangulations for the GPU: triangles are sorted
+ * for post-transform vertex cache reuse with Forsyth's algorithm, and nodes
+ * are renumbered in the order the triangles first use them, so that vertex
+ * fetches run through memory front to back. The edge polygons that refer to
+ * the nodes are renumbered with them.
+ *
+ * Counts the vertex shader invocations a FIFO cache of FifoSize entries
+ * would need for every optimized triangulation, before and after, over the
+ * lifetime of the module.
+ */
+class MeshOptimizer {
+public:
+  static int const CacheSize = 32; // cache modelled by the scoring
+  static int const FifoSize = 16;  // cache modelled for the statistics
+
+  /**
+   * @param count Parts with fewer new triangles keep the order of the mesher;
+   *              0 turns the optimization off. Defaults to 4096.
+   */
+  static void setMinPartTriangles(size_t count);
+  static size_t minPartTriangles();
+
+  /**
+   * Reorders one triangulation in place. Must not run while the
+   * triangulation is drawn or read by another thread.
+   *
+   * @param face The face the triangulation belongs to.
+   * @param triangulation The triangulation to reorder.
+   */
+  static void optimize(TopoDS_Face const &face,
+                       Handle(Poly_Triangulation) const &triangulation);
+
+  static size_t optimizedCount();
+  static size_t triangleCount();
+  static size_t invocationsBefore();
+  static size_t invocationsAfter();
+
+private:
+  static std::atomic<size_t> minTriangles;
+  static std::atomic<size_t> optimized;
+  static std::atomic<size_t> triangles;
+  static std::atomic<size_t> before;
+  static std::atomic<size_t> after;
+};
+
+#endif // MESHOPTIMIZER_HPP
@@ -0,0 +1,120 @@
+#include "MeshScheduler.hpp"
+#include <algorithm>
+#include <emscripten.h>
+#include <opencascade/Graphic3d_CullingTool.hxx>
+
+double projectedArea(Handle(Graphic3d_Camera) const &camera, int width,
+                     int height, Bnd_Box const &box) {
+  if (box.IsVoid()) { return 0.0; }
+
+  Graphic3d_Mat4d const &orientation = camera->OrientationMatrix();
+  Graphic3d_Mat4d const &projection = camera->ProjectionMatrix();
+  gp_Pnt const lo = box.CornerMin();
+  gp_Pnt const hi = box.CornerMax();
+
+  double minX = 1.0, minY = 1.0, maxX = -1.0, maxY = -1.0;
+  for (int corner = 0; corner < 8; ++corner) {
+    Graphic3d_Vec4d const eye =
+        orientation * Graphic3d_Vec4d((corner & 1) ? hi.X() : lo.X(),
+                                      (corner & 2) ? hi.Y() : lo.Y(),
+                                      (corner & 4) ? hi.Z() : lo.Z(), 1.0);
+    // The camera looks down -Z in eye space.
+    if (eye.z() >= 0.0) { return double(width) * height; }
+
+    Graphic3d_Vec4d const clip = projection * eye;
+    minX = std::min(minX, clip.x() / clip.w());
+    maxX = std::max(maxX, clip.x() / clip.w());
+    minY = std::min(minY, clip.y() / clip.w());
+    maxY = std::max(maxY, clip.y() / clip.w());
+  }
+
+  double const dx = std::clamp(maxX, -1.0, 1.0) - std::clamp(minX, -1.0, 1.0);
+  double const dy = std::clamp(maxY, -1.0, 1.0) - std::clamp(minY, -1.0, 1.0);
+  return std::max(dx, 0.0) * 0.5 * width * std::max(dy, 0.0) * 0.5 * height;
+}
+
+void MeshScheduler::rank(Handle(Graphic3d_Camera) const &camera, int width,
+                         int height, std::vector<Bnd_Box> const &boxes,
+                         std::function<bool(size_t)> const &isFinal) {
+  Graphic3d_CullingTool culling;
+  culling.SetViewVolume(camera);
+  culling.SetViewportSize(width, height, 1.0);
+  culling.CacheClipPtsProjections();
+  Graphic3d_CullingTool::CullingContext cullingContext;
+  culling.SetCullingDistance(cullingContext, -1.0);
+  culling.SetCullingSize(cullingContext, -1.0);
+
+  order.clear();
+  areas.assign(boxes.size(), 0.0);
+  visibleArea = 0.0;
+  finalArea = 0.0;
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    Bnd_Box const &box = boxes[i];
+    if (box.IsVoid()) { continue; }
+
+    gp_Pnt const lo = box.CornerMin();
+    gp_Pnt const hi = box.CornerMax();
+    if (culling.IsCulled(cullingContext, Graphic3d_Vec3d(lo.X(), lo.Y(), lo.Z()),
+                         Graphic3d_Vec3d(hi.X(), hi.Y(), hi.Z()))) {
+      continue;
+    }
+
+    // Boxes in view count as visible even if they project to a point.
+    areas[i] = std::max(projectedArea(camera, width, height, box), 1e-6);
+    order.push_back(i);
+    visibleArea += areas[i];
+    if (isFinal(i)) { finalArea += areas[i]; }
+  }
+
+  std::sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return areas[a] > areas[b]; });
+  firstTiny = std::partition_point(order.begin(), order.end(),
+                                   [this](size_t i) {
+                                     return areas[i] >= TinyArea;
+                                   }) -
+              order.begin();
+  cursor = 0;
+
+  rankedAt = emscripten_get_now();
+  ninetyPercentReached = false;
+  checkNinetyPercent();
+}
+
+std::optional<size_t>
+MeshScheduler::next(std::function<bool(size_t)> const &isWaiting,
+                    bool includeTiny) {
+  size_t const end = includeTiny ? order.size() : firstTiny;
+  for (; cursor < end; ++cursor) {
+    if (isWaiting(order[cursor])) { return order[cursor++]; }
+  }
+  return std::nullopt;
+}
+
+bool MeshScheduler::isVisible(size_t item) const {
+  return item < areas.size() && areas[item] > 0.0;
+}
+
+void MeshScheduler::markFinal(size_t item) {
+  if (!isVisible(item)) { return; }
+  finalArea += areas[item];
+  checkNinetyPercent();
+}
+
+void MeshScheduler::markNotFinal(size_t item) {
+  if (isVisible(item)) { finalArea -= areas[item]; }
+}
+
+double MeshScheduler::finalFraction() const {
+  return visibleArea > 0.0 ? std::min(finalArea / visibleArea, 1.0) : 1.0;
+}
+
+double MeshScheduler::timeToNinetyPercent() const {
+  return ninetyPercentAfter;
+}
+
+void MeshScheduler::checkNinetyPercent() {
+  if (!ninetyPercentReached && finalFraction() >= 0.9) {
+    ninetyPercentReached = true;
+    ninetyPercentAfter = emscripten_get_now() - rankedAt;
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef MESHSCHEDULER_HPP
+#define MESHSCHEDULER_HPP
+#include <cstddef>
+#include <functional>
+#include <opencascade/Bnd_Box.hxx>
+#include <opencascade/Graphic3d_Camera.hxx>
+#include <optional>
+#include <vector>
+
+/**
+ * Orders mesh jobs by how much of the screen they cover from the current
+ * camera. Items outside the view frustum are left out. Items whose projected
+ * box is smaller than a few pixels come after all larger ones, and are held
+ * back while the camera moves. rank() is called again whenever it moves.
+ *
+ * Also tracks which share of the visible area is final, i.e. covered by
+ * items that are meshed and displayed, and how long it took to reach 90%.
+ */
+class MeshScheduler {
+public:
+  static constexpr double TinyArea = 16.0; // square pixels
+
+  /**
+   * @param camera The camera to rank for.
+   * @param width Viewport width in pixels.
+   * @param height Viewport height in pixels.
+   * @param boxes World-space bounds, one per item.
+   * @param isFinal Whether an item is already displayed.
+   */
+  void rank(Handle(Graphic3d_Camera) const &camera, int width, int height,
+            std::vector<Bnd_Box> const &boxes,
+            std::function<bool(size_t)> const &isFinal);
+
+  /**
+   * Returns the most important visible item for which isWaiting() holds, or
+   * nothing once every visible item was handed out.
+   *
+   * @param isWaiting Whether an item still needs to be meshed.
+   * @param includeTiny Whether to hand out items below TinyArea.
+   */
+  std::optional<size_t> next(std::function<bool(size_t)> const &isWaiting,
+                             bool includeTiny);
+
+  bool isVisible(size_t item) const;
+  void markFinal(size_t item);
+  void markNotFinal(size_t item);
+
+  /** Share of the visible projected area covered by final items. */
+  double finalFraction() const;
+
+  /** Milliseconds from the last rank() until 90% of the area was final. */
+  double timeToNinetyPercent() const;
+
+private:
+  std::vector<size_t> order; // visible items, largest projected area first
+  std::vector<double> areas; // projected area per item, 0 when culled
+  size_t cursor = 0;
+  size_t firstTiny = 0;
+
+  double visibleArea = 0.0;
+  double finalArea = 0.0;
+  double rankedAt = 0.0;
+  double ninetyPercentAfter = 0.0;
+  bool ninetyPercentReached = false;
+
+  void checkNinetyPercent();
+};
+
+/**
+ * Projected area of a box in pixels, clamped to the viewport. Boxes that
+ * reach behind the eye count as covering the whole viewport.
+ */
+double projectedArea(Handle(Graphic3d_Camera) const &camera, int width,
+                     int height, Bnd_Box const &box);
+
+#endif // MESHSCHEDULER_HPP
@@ -0,0 +1,125 @@
+#include "ModelRegistry.hpp"
+#include "WorkerPool.hpp"
+#include "staircase.hpp"
+#include <opencascade/BRepTools.hxx>
+#include <opencascade/TDF_LabelSequence.hxx>
+#include <opencascade/XCAFApp_Application.hxx>
+#include <opencascade/XCAFDoc_DocumentTool.hxx>
+#include <opencascade/XCAFDoc_ShapeTool.hxx>
+
+std::mutex ModelRegistry::registryMutex;
+std::unordered_map<ModelKey, std::weak_ptr<LoadedModel>, ModelKeyHash>
+    ModelRegistry::models;
+std::unordered_set<ModelKey, ModelKeyHash> ModelRegistry::loading;
+std::condition_variable ModelRegistry::loadingDone;
+
+LoadedModel::~LoadedModel() {
+  debugOut("LoadedModel::~LoadedModel(): key=", key.hash);
+  if (!doc.IsNull() && doc->IsOpened()) {
+    XCAFApp_Application::GetApplication()->Close(doc);
+  }
+}
+
+ModelUse::ModelUse(std::shared_ptr<LoadedModel> model) : model(std::move(model)) {
+  if (this->model) { ++this->model->uses; }
+}
+
+ModelUse &ModelUse::operator=(ModelUse &&other) noexcept {
+  if (this != &other) {
+    release();
+    model = std::move(other.model);
+  }
+  return *this;
+}
+
+void ModelUse::release() {
+  if (!model) { return; }
+  if (--model->uses == 0) {
+    // Not on the main thread: the exclusive lock waits for the pool jobs
+    // that still read the triangulations.
+    WorkerPool::submit([model = std::move(model)]() {
+      std::unique_lock<std::shared_mutex> lock(model->triangulationMutex);
+      if (model->uses > 0) { return; }
+      for (auto const &part : model->parts) { BRepTools::Clean(part.shape); }
+      if (model->key.lazy) {
+        // The branches are shapes of the document's free shapes.
+        TDF_LabelSequence freeShapes;
+        XCAFDoc_DocumentTool::ShapeTool(model->doc->Main())->GetFreeShapes(freeShapes);
+        for (TDF_LabelSequence::Iterator it(freeShapes); it.More(); it.Next()) {
+          BRepTools::Clean(XCAFDoc_ShapeTool::GetShape(it.Value()));
+        }
+      }
+      model->meshed = false;
+    });
+  }
+  model.reset();
+}
+
+ModelClaim::~ModelClaim() {
+  if (!key) { return; }
+  std::lock_guard<std::mutex> lock(ModelRegistry::registryMutex);
+  ModelRegistry::endClaim(*this);
+}
+
+ModelKey ModelRegistry::contentKey(std::string const &content, bool lazy) {
+  // FNV-1a, confirmed by a polynomial hash with another multiplier.
+  ModelKey key;
+  key.hash = 14695981039346656037ull;
+  key.check = 0;
+  for (unsigned char c : content) {
+    key.hash ^= c;
+    key.hash *= 1099511628211ull;
+    key.check = key.check * 0x9E3779B97F4A7C15ull + c + 1;
+  }
+  key.size = content.size();
+  key.lazy = lazy;
+  return key;
+}
+
+std::shared_ptr<LoadedModel> ModelRegistry::findOrClaim(ModelKey const &key,
+                                                        ModelClaim &claim) {
+  std::unique_lock<std::mutex> lock(registryMutex);
+  loadingDone.wait(lock, [&key] { return loading.count(key) == 0; });
+
+  auto it = models.find(key);
+  if (it != models.end()) {
+    if (auto model = it->second.lock()) { return model; }
+    models.erase(it);
+  }
+  loading.insert(key);
+  claim.key = key;
+  return nullptr;
+}
+
+std::shared_ptr<LoadedModel>
+ModelRegistry::insert(std::shared_ptr<LoadedModel> const &model,
+                      ModelClaim &claim) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  pruneExpired();
+  endClaim(claim);
+  models[model->key] = model;
+  return model;
+}
+
+size_t ModelRegistry::size() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  pruneExpired();
+  return models.size();
+}
+
+void ModelRegistry::endClaim(ModelClaim &claim) {
+  if (!claim.key) { return; }
+  loading.erase(*claim.key);
+  claim.key.reset();
+  loadingDone.notify_all();
+}
+
+void ModelRegistry::pruneExpired() {
+  for (auto it = models.begin(); it != models.end();) {
+    if (it->second.expired()) {
+      it = models.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
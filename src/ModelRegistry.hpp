@@ -0,0 +1,179 @@
+#ifndef MODELREGISTRY_HPP
+#define MODELREGISTRY_HPP
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <opencascade/Quantity_Color.hxx>
+#include <opencascade/TDocStd_Document.hxx>
+#include <opencascade/TopoDS_Shape.hxx>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ModelPart {
+  TopoDS_Shape shape;
+  std::optional<Quantity_Color> color;
+};
+
+/**
+ * Identity of loaded STEP content. A hit on the hash is only taken for the
+ * same content if the size and an independent second hash match as well.
+ */
+struct ModelKey {
+  uint64_t hash = 0;
+  uint64_t check = 0;
+  uint64_t size = 0;
+  // Lazy models are keyed apart from fully loaded ones.
+  bool lazy = false;
+
+  bool operator==(ModelKey const &other) const {
+    return hash == other.hash && check == other.check && size == other.size &&
+           lazy == other.lazy;
+  }
+};
+
+struct ModelKeyHash {
+  size_t operator()(ModelKey const &key) const {
+    return size_t(key.hash) ^ size_t(key.lazy);
+  }
+};
+
+/**
+ * A parsed and meshed STEP document. One instance is shared by every viewer
+ * in the module that shows the same file content; the document is closed
+ * when the last viewer releases it.
+ *
+ * Indexes and caches built from the model belong to the modules that use
+ * them and are attached to it; see attached().
+ */
+struct LoadedModel {
+  // key.lazy models have no parts; LazyScene meshes their branches.
+  ModelKey key;
+  Handle(TDocStd_Document) doc;
+  std::vector<ModelPart> parts;
+  // Held shared while meshing or reading triangulations and exclusively to
+  // drop them again.
+  std::shared_mutex triangulationMutex;
+  // Whether the parts are triangulated; guarded by triangulationMutex.
+  bool meshed = true;
+  // Viewers that show the model or are about to; see ModelUse.
+  std::atomic<unsigned int> uses{0};
+
+  ~LoadedModel();
+
+  /**
+   * The model's instance of a module's per-model data, default constructed
+   * on first use and freed with the model. The module guards its data;
+   * data filled in before the model is shared needs no lock.
+   */
+  template <typename T> T &attached();
+
+private:
+  struct Attachment {
+    virtual ~Attachment() = default;
+  };
+  template <typename T> struct Holder : Attachment {
+    T value;
+  };
+
+  std::mutex attachmentMutex;
+  std::unordered_map<std::type_index, std::unique_ptr<Attachment>> attachments;
+};
+
+template <typename T> T &LoadedModel::attached() {
+  std::lock_guard<std::mutex> lock(attachmentMutex);
+  std::unique_ptr<Attachment> &attachment = attachments[std::type_index(typeid(T))];
+  if (!attachment) { attachment = std::make_unique<Holder<T>>(); }
+  return static_cast<Holder<T> &>(*attachment).value;
+}
+
+/**
+ * A viewer's claim on the triangulations of a model it shows or is about to
+ * show. When the last use of a model is released, a pool job drops the
+ * triangulations of its parts, unless a new use came along in the meantime;
+ * ensureMeshed() brings them back for the next one.
+ */
+class ModelUse {
+public:
+  ModelUse() = default;
+  explicit ModelUse(std::shared_ptr<LoadedModel> model);
+  ModelUse(ModelUse &&other) noexcept = default;
+  ModelUse &operator=(ModelUse &&other) noexcept;
+  ModelUse(ModelUse const &) = delete;
+  ModelUse &operator=(ModelUse const &) = delete;
+  ~ModelUse() { release(); }
+
+  std::shared_ptr<LoadedModel> const &get() const { return model; }
+  explicit operator bool() const { return model != nullptr; }
+
+private:
+  std::shared_ptr<LoadedModel> model;
+
+  void release();
+};
+
+/**
+ * The right to load the model for a key that is neither registered nor
+ * being loaded. While it is held, other threads looking the key up wait
+ * for the model instead of parsing the same content again. Inserting the
+ * model ends the claim; dropping it unloaded lets the next one try.
+ */
+class ModelClaim {
+public:
+  ModelClaim() = default;
+  ModelClaim(ModelClaim const &) = delete;
+  ModelClaim &operator=(ModelClaim const &) = delete;
+  ~ModelClaim();
+
+  explicit operator bool() const { return key.has_value(); }
+
+private:
+  friend class ModelRegistry;
+  std::optional<ModelKey> key;
+};
+
+class ModelRegistry {
+public:
+  /**
+   * Hashes STEP file content into the key used to look up shared models.
+   *
+   * @param content The raw STEP file content.
+   * @param lazy Lazy models are keyed apart from fully loaded ones.
+   */
+  static ModelKey contentKey(std::string const &content, bool lazy = false);
+
+  /**
+   * Finds the model for a key, waiting while another thread holds its
+   * claim. If there is none, claim takes the right to load it and nullptr
+   * is returned.
+   */
+  static std::shared_ptr<LoadedModel> findOrClaim(ModelKey const &key,
+                                                  ModelClaim &claim);
+  /** Registers a claimed model and ends the claim. */
+  static std::shared_ptr<LoadedModel>
+  insert(std::shared_ptr<LoadedModel> const &model, ModelClaim &claim);
+  static size_t size();
+
+private:
+  friend class ModelClaim;
+
+  static std::mutex registryMutex;
+  static std::unordered_map<ModelKey, std::weak_ptr<LoadedModel>, ModelKeyHash>
+      models;
+  // Keys of models being loaded under a claim.
+  static std::unordered_set<ModelKey, ModelKeyHash> loading;
+  static std::condition_variable loadingDone;
+
+  static void endClaim(ModelClaim &claim);
+
+  static void pruneExpired();
+};
+
+#endif // MODELREGISTRY_HPP
@@ -1,38 +1,253 @@
 #include "OCCTUtilities.hpp"
+#include "LazyScene.hpp"
+#include "LoadArena.hpp"
+#include "MeshOptimizer.hpp"
+#include "PartIndex.hpp"
+#include "ProductIndex.hpp"
+#include "WorkerPool.hpp"
 #include <GLES2/gl2.h>
 #include <OpenGl_GraphicDriver.hxx>
 #include <Wasm_Window.hxx>
 #include <XCAFDoc_DocumentTool.hxx>
 #include <emscripten.h>
 #include <opencascade/AIS_Shape.hxx>
+#include <opencascade/BRepBndLib.hxx>
+#include <opencascade/BRep_Tool.hxx>
+#include <opencascade/BRepBuilderAPI_Transform.hxx>
+#include <opencascade/BRepPrimAPI_MakeCylinder.hxx>
+#include <opencascade/Message_ProgressIndicator.hxx>
+#include <opencascade/Message_ProgressScope.hxx>
+#include <opencascade/Prs3d_Drawer.hxx>
+#include <opencascade/Interface_InterfaceModel.hxx>
 #include <opencascade/STEPCAFControl_Reader.hxx>
+#include <opencascade/StepBasic_ProductDefinition.hxx>
+#include <opencascade/StepBasic_ProductDefinitionRelationship.hxx>
+#include <opencascade/StdPrs_ToolTriangulatedShape.hxx>
 #include <opencascade/TDF_ChildIterator.hxx>
+#include <opencascade/TDF_LabelSequence.hxx>
 #include <opencascade/TDataStd_Name.hxx>
 #include <opencascade/TDocStd_Document.hxx>
+#include <opencascade/TopExp_Explorer.hxx>
+#include <opencascade/TopTools_DataMapOfShapeInteger.hxx>
+#include <opencascade/TopoDS.hxx>
 #include <opencascade/XCAFDoc_ColorTool.hxx>
+#include <opencascade/XCAFDoc_Editor.hxx>
 #include <opencascade/XCAFDoc_ShapeTool.hxx>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
 #include <unordered_set>
+namespace {
+// Forwards OCCT's transfer progress to the viewer stats.
+class StatsProgressIndicator : public Message_ProgressIndicator {
+public:
+  StatsProgressIndicator(ViewerStats *stats) : stats(stats) {}
+
+  void Show(Message_ProgressScope const &, Standard_Boolean const) override {
+    if (stats) { stats->setTransferProgress(GetPosition()); }
+  }
+
+private:
+  ViewerStats *stats;
+};
+
+// Groups the transfer roots of a read file into sets that share no product:
+// roots whose product trees are linked by a product definition relationship,
+// such as an assembly usage, end up in the same group. Groups list their
+// roots in file order and are ordered by their first root.
+std::vector<std::vector<int>> independentRoots(STEPControl_Reader &reader) {
+  Handle(Interface_InterfaceModel) model = reader.Model();
+  std::vector<int> parent(model->NbEntities() + 1);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int entity) {
+    while (parent[entity] != entity) {
+      parent[entity] = parent[parent[entity]];
+      entity = parent[entity];
+    }
+    return entity;
+  };
+
+  for (int i = 1; i <= model->NbEntities(); ++i) {
+    auto relationship =
+        Handle(StepBasic_ProductDefinitionRelationship)::DownCast(model->Value(i));
+    if (relationship.IsNull()) { continue; }
+    int const relating = model->Number(relationship->RelatingProductDefinition());
+    int const related = model->Number(relationship->RelatedProductDefinition());
+    if (relating > 0 && related > 0) { parent[find(relating)] = find(related); }
+  }
+
+  std::vector<std::vector<int>> groups;
+  std::unordered_map<int, size_t> groupOf;
+  for (int root = 1; root <= reader.NbRootsForTransfer(); ++root) {
+    int const entity = model->Number(reader.RootForTransfer(root));
+    // Roots outside the model cannot share anything.
+    int const key = entity > 0 ? find(entity) : -root;
+    auto const [it, added] = groupOf.emplace(key, groups.size());
+    if (added) { groups.emplace_back(); }
+    groups[it->second].push_back(root);
+  }
+  return groups;
+}
+} // namespace
+
 std::optional<Handle(TDocStd_Document)>
 readInto(std::function<Handle(TDocStd_Document)()> aNewDoc,
-         std::istream &fromStream) {
+         std::istream &fromStream, ViewerStats *stats) {
+
+  Handle(TDocStd_Document) aDoc = aNewDoc();
+  LoadArena::Stats const arenaBefore = LoadArena::stats();
+
+  IFSelect_ReturnStatus aStatus;
+  bool success = false;
+  {
+    STEPCAFControl_Reader aStepReader;
+    {
+      // The entities read here are released with the reader below; keep
+      // them together so that their memory goes back to the heap in whole
+      // chunks. The transfer is left out: the shapes it makes outlive the
+      // reader and would pin the chunks.
+      LoadArena::Scope arenaScope;
+      PhaseTimer timer(stats, LoadPhase::Read);
+      aStatus = aStepReader.ReadStream("Embedded STEP Data", fromStream);
+    }
+
+    if (aStatus == IFSelect_RetDone) {
+      PhaseTimer timer(stats, LoadPhase::Transfer);
+      Handle(StatsProgressIndicator) aProgress = new StatsProgressIndicator(stats);
+      success = aStepReader.Transfer(aDoc, aProgress->Start());
+    }
+  }
+
+  // With the reader gone, the chunks this load left behind are pinned by
+  // blocks that outlive it. Chunks of earlier loads freed meanwhile make
+  // this an estimate.
+  LoadArena::Stats const arenaAfter = LoadArena::stats();
+  uint64_t const allocated = arenaAfter.chunksAllocated - arenaBefore.chunksAllocated;
+  uint64_t const released = arenaAfter.chunksReleased - arenaBefore.chunksReleased;
+  if (stats) {
+    stats->setArenaChunksPinned(allocated > released ? allocated - released : 0);
+  }
+
+  if (aStatus != IFSelect_RetDone) {
+    std::cerr << "Error reading STEP file." << std::endl;
+    return std::nullopt;
+  }
+  if (!success) {
+    std::cerr << "Transfer failed." << std::endl;
+    return std::nullopt;
+  }
+
+  return aDoc;
+}
+
+std::optional<Handle(TDocStd_Document)>
+readIntoParallel(std::function<Handle(TDocStd_Document)()> aNewDoc,
+                 std::string const &content, size_t maxPartitions,
+                 ViewerStats *stats) {
 
   Handle(TDocStd_Document) aDoc = aNewDoc();
   STEPCAFControl_Reader aStepReader;
 
-  IFSelect_ReturnStatus aStatus =
-      aStepReader.ReadStream("Embedded STEP Data", fromStream);
+  IFSelect_ReturnStatus aStatus;
+  {
+    PhaseTimer timer(stats, LoadPhase::Read);
+    std::istringstream fromStream(content);
+    aStatus = aStepReader.ReadStream("Embedded STEP Data", fromStream);
+  }
 
   if (aStatus != IFSelect_RetDone) {
     std::cerr << "Error reading STEP file." << std::endl;
     return std::nullopt;
   }
 
-  bool success = aStepReader.Transfer(aDoc);
+  PhaseTimer timer(stats, LoadPhase::Transfer);
+  int const nbRoots = aStepReader.NbRootsForTransfer();
+  std::vector<std::vector<int>> const groups =
+      independentRoots(aStepReader.ChangeReader());
+  size_t partitions =
+      std::min({WorkerPool::size() + 1, maxPartitions, groups.size()});
+
+  // Whole groups go to partitions in order, about the same number of roots
+  // to each; a large group can leave a partition empty.
+  std::vector<std::vector<int>> partitionRoots(partitions);
+  size_t assigned = 0;
+  for (auto const &group : groups) {
+    size_t const p = assigned * partitions / static_cast<size_t>(nbRoots);
+    partitionRoots[p].insert(partitionRoots[p].end(), group.begin(), group.end());
+    assigned += group.size();
+  }
+  partitionRoots.erase(
+      std::remove_if(partitionRoots.begin(), partitionRoots.end(),
+                     [](auto const &roots) { return roots.empty(); }),
+      partitionRoots.end());
+  partitions = partitionRoots.size();
+  if (stats) { stats->setTransferPartitions(partitions); }
+
+  if (partitions < 2) {
+    if (!aStepReader.Transfer(aDoc)) {
+      std::cerr << "Transfer failed." << std::endl;
+      return std::nullopt;
+    }
+    return aDoc;
+  }
+
+  // NewDocument registers the document with the application, so the
+  // partition documents are created here rather than on the pool.
+  std::vector<Handle(TDocStd_Document)> partDocs(partitions);
+  for (auto &partDoc : partDocs) {
+    partDoc = aNewDoc();
+  }
+  std::vector<char> transferred(partitions, 0);
+
+  // Merging the partitions in order keeps the root order of the file unless
+  // groups interleave. The first partition reuses the model read above; the
+  // others read their own copy, since a model and its transfer maps can only
+  // be used by one thread.
+  WorkerPool::parallelFor(partitions, [&](size_t p) {
+    TRACE_SCOPE("transferPartition");
+    STEPCAFControl_Reader partReader;
+    STEPCAFControl_Reader *reader = &aStepReader;
+    if (p != 0) {
+      std::istringstream fromStream(content);
+      if (partReader.ReadStream("Embedded STEP Data", fromStream) !=
+          IFSelect_RetDone) {
+        return;
+      }
+      reader = &partReader;
+    }
+
+    // Every root runs the XCAF name, color and layer passes of its own.
+    bool ok = true;
+    for (size_t i = 0; ok && i < partitionRoots[p].size(); ++i) {
+      ok = reader->TransferOneRoot(partitionRoots[p][i], partDocs[p]);
+    }
+    transferred[p] = ok;
+  });
+
+  bool success = true;
+  {
+    TRACE_SCOPE("mergePartitions");
+    for (size_t p = 0; p < partitions; ++p) {
+      success = success && transferred[p];
+
+      TDF_LabelSequence freeShapes;
+      XCAFDoc_DocumentTool::ShapeTool(partDocs[p]->Main())
+          ->GetFreeShapes(freeShapes);
+      if (success && !freeShapes.IsEmpty()) {
+        // Copies assemblies with their components, names, colors and layers.
+        // No product is in two partitions, so instancing survives.
+        success = XCAFDoc_Editor::Extract(freeShapes, aDoc->Main());
+      }
+      XCAFApp_Application::GetApplication()->Close(partDocs[p]);
+    }
+  }
 
   if (!success) {
     std::cerr << "Transfer failed." << std::endl;
     return std::nullopt;
   }
+  if (stats) { stats->setTransferProgress(1.0); }
 
   return aDoc;
 }
@@ -58,7 +273,8 @@ void printLabels(TDF_Label const &label, int level) {
 
 void readStepFile(
     Handle(XCAFApp_Application) app, std::string stepFileStr,
-    std::function<void(std::optional<Handle(TDocStd_Document)>)> callback) {
+    std::function<void(std::optional<Handle(TDocStd_Document)>)> callback,
+    ViewerStats *stats, size_t transferPartitions) {
 
   auto aNewDoc = [&]() -> Handle(TDocStd_Document) {
     Handle(TDocStd_Document) aDoc;
@@ -66,13 +282,15 @@ void readStepFile(
     return aDoc;
   };
 
-  std::istringstream fromStream(stepFileStr);
-
   std::optional<Handle(TDocStd_Document)> docOpt;
 
-  {
-    Timer timer = Timer("readInto(aNewDoc, fromStream)");
-    docOpt = readInto(aNewDoc, fromStream);
+  if (transferPartitions > 1) {
+    TRACE_SCOPE("readIntoParallel");
+    docOpt = readIntoParallel(aNewDoc, stepFileStr, transferPartitions, stats);
+  } else {
+    TRACE_SCOPE("readInto");
+    std::istringstream fromStream(stepFileStr);
+    docOpt = readInto(aNewDoc, fromStream, stats);
   }
 
   callback(docOpt);
@@ -137,3 +355,226 @@ std::vector<TopoDS_Shape> getShapesFromDoc(Handle(TDocStd_Document)
     }
     return shapes;
 }
+
+void meshShape(TopoDS_Shape const &shape) {
+  TRACE_SCOPE("meshShape");
+  static Handle(Prs3d_Drawer) const aDrawer = [] {
+    Handle(Prs3d_Drawer) drawer = new Prs3d_Drawer();
+    drawer->SetupOwnDefaults();
+    return drawer;
+  }();
+
+  // Only triangulations made here are reordered; older ones may be drawn.
+  // Holding the handles keeps a replaced triangulation's address from being
+  // reused by a new one.
+  std::vector<Handle(Poly_Triangulation)> previous;
+  for (TopExp_Explorer exp(shape, TopAbs_FACE); exp.More(); exp.Next()) {
+    TopLoc_Location location;
+    previous.push_back(
+        BRep_Tool::Triangulation(TopoDS::Face(exp.Current()), location));
+  }
+
+  StdPrs_ToolTriangulatedShape::Tessellate(shape, aDrawer);
+  computeNormals(shape);
+
+  size_t const minTriangles = MeshOptimizer::minPartTriangles();
+  if (minTriangles == 0) { return; }
+
+  std::vector<std::pair<TopoDS_Face, Handle(Poly_Triangulation)>> created;
+  std::unordered_set<Poly_Triangulation const *> seen;
+  size_t newTriangles = 0;
+  size_t face = 0;
+  for (TopExp_Explorer exp(shape, TopAbs_FACE); exp.More(); exp.Next(), ++face) {
+    TopLoc_Location location;
+    Handle(Poly_Triangulation) triangulation =
+        BRep_Tool::Triangulation(TopoDS::Face(exp.Current()), location);
+    if (!triangulation.IsNull() && triangulation != previous[face] &&
+        seen.insert(triangulation.get()).second) {
+      created.emplace_back(TopoDS::Face(exp.Current()), triangulation);
+      newTriangles += triangulation->NbTriangles();
+    }
+  }
+  if (newTriangles < minTriangles) { return; }
+
+  for (auto const &[meshedFace, triangulation] : created) {
+    MeshOptimizer::optimize(meshedFace, triangulation);
+  }
+}
+
+void computeNormals(TopoDS_Shape const &shape) {
+  for (TopExp_Explorer exp(shape, TopAbs_FACE); exp.More(); exp.Next()) {
+    TopLoc_Location location;
+    Handle(Poly_Triangulation) const &triangulation =
+        BRep_Tool::Triangulation(TopoDS::Face(exp.Current()), location);
+    if (!triangulation.IsNull() && !triangulation->HasNormals()) {
+      StdPrs_ToolTriangulatedShape::ComputeNormals(TopoDS::Face(exp.Current()),
+                                                   triangulation);
+    }
+  }
+}
+
+void ensureMeshed(LoadedModel &model) {
+  {
+    std::shared_lock<std::shared_mutex> lock(model.triangulationMutex);
+    if (model.meshed) { return; }
+  }
+  TRACE_SCOPE("ensureMeshed");
+  std::unique_lock<std::shared_mutex> lock(model.triangulationMutex);
+  if (model.meshed) { return; }
+  for (auto const &part : model.parts) { meshShape(part.shape); }
+  model.meshed = true;
+}
+
+void forEachTriangulation(
+    TopoDS_Shape const &shape,
+    std::function<void(TopoDS_Face const &, Handle(Poly_Triangulation) const &,
+                       TopLoc_Location const &)> const &body) {
+  for (TopExp_Explorer exp(shape, TopAbs_FACE); exp.More(); exp.Next()) {
+    TopoDS_Face const &face = TopoDS::Face(exp.Current());
+    TopLoc_Location location;
+    Handle(Poly_Triangulation) triangulation =
+        BRep_Tool::Triangulation(face, location);
+    if (!triangulation.IsNull()) { body(face, triangulation, location); }
+  }
+}
+
+std::shared_ptr<LoadedModel> buildModel(ModelKey const &key,
+                                        Handle(TDocStd_Document) aDoc,
+                                        ViewerStats *stats) {
+  auto model = std::make_shared<LoadedModel>();
+  model->key = key;
+  model->doc = aDoc;
+
+  {
+    PhaseTimer timer(stats, LoadPhase::Traversal);
+    for (auto const &shape : getShapesFromDoc(aDoc)) {
+      model->parts.push_back({shape, getShapeColor(aDoc, shape)});
+    }
+  }
+
+  {
+    PhaseTimer timer(stats, LoadPhase::Mesh);
+    for (auto const &part : model->parts) {
+      meshShape(part.shape);
+    }
+  }
+
+  {
+    PhaseTimer timer(stats, LoadPhase::Index);
+    std::vector<Bnd_Box> boxes(model->parts.size());
+    WorkerPool::parallelFor(model->parts.size(), [&model, &boxes](size_t i) {
+      BRepBndLib::Add(model->parts[i].shape, boxes[i], true);
+    });
+    model->attached<PartIndex>() = PartIndex(boxes);
+
+    std::vector<TopoDS_Shape> shapes;
+    shapes.reserve(model->parts.size());
+    for (auto const &part : model->parts) { shapes.push_back(part.shape); }
+    model->attached<ProductIndex>() = ProductIndex(aDoc, shapes);
+  }
+  return model;
+}
+
+std::shared_ptr<LoadedModel> buildLazyModel(ModelKey const &key,
+                                            Handle(TDocStd_Document) aDoc,
+                                            ViewerStats *stats) {
+  auto model = std::make_shared<LoadedModel>();
+  model->key = key;
+  model->key.lazy = true;
+  model->doc = aDoc;
+  LazyBranches &lazy = model->attached<LazyBranches>();
+
+  PhaseTimer timer(stats, LoadPhase::Traversal);
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(aDoc->Main());
+
+  TDF_LabelSequence freeShapes;
+  shapeTool->GetFreeShapes(freeShapes);
+  for (TDF_LabelSequence::Iterator it(freeShapes); it.More(); it.Next()) {
+    TDF_LabelSequence components;
+    if (shapeTool->IsAssembly(it.Value()) &&
+        shapeTool->GetComponents(it.Value(), components) &&
+        !components.IsEmpty()) {
+      for (TDF_LabelSequence::Iterator comp(components); comp.More();
+           comp.Next()) {
+        // Component labels give the shape placed in its parent assembly.
+        lazy.branches.push_back(
+            {comp.Value(), shapeTool->GetShape(comp.Value()), Bnd_Box()});
+      }
+    } else {
+      lazy.branches.push_back(
+          {it.Value(), shapeTool->GetShape(it.Value()), Bnd_Box()});
+    }
+  }
+
+  // Components share the faces of their prototypes; joins the branches
+  // that share any face into one group.
+  std::vector<size_t> root(lazy.branches.size());
+  std::iota(root.begin(), root.end(), size_t(0));
+  auto find = [&root](size_t i) {
+    while (root[i] != i) { i = root[i] = root[root[i]]; }
+    return i;
+  };
+  TopTools_DataMapOfShapeInteger branchOfFace;
+  for (size_t i = 0; i < lazy.branches.size(); ++i) {
+    TopoDS_Shape const &shape = lazy.branches[i].shape;
+    if (shape.IsNull()) { continue; }
+    for (TopExp_Explorer exp(shape, TopAbs_FACE); exp.More(); exp.Next()) {
+      TopoDS_Shape const face = exp.Current().Located(TopLoc_Location());
+      if (int const *other = branchOfFace.Seek(face)) {
+        root[find(i)] = find(size_t(*other));
+      } else {
+        branchOfFace.Bind(face, int(i));
+      }
+    }
+  }
+  std::unordered_map<size_t, size_t> groupOfRoot;
+  for (size_t i = 0; i < lazy.branches.size(); ++i) {
+    auto const [it, added] = groupOfRoot.emplace(find(i), groupOfRoot.size());
+    lazy.branches[i].group = it->second;
+  }
+  lazy.groupUsers.assign(groupOfRoot.size(), 0);
+  for (size_t g = 0; g < groupOfRoot.size(); ++g) {
+    lazy.groupMutexes.push_back(std::make_unique<std::mutex>());
+  }
+
+  // Boxes come from the exact geometry, since nothing is meshed yet.
+  WorkerPool::parallelFor(lazy.branches.size(), [&lazy](size_t i) {
+    ModelBranch &branch = lazy.branches[i];
+    if (!branch.shape.IsNull()) {
+      BRepBndLib::Add(branch.shape, branch.box, false);
+    }
+  });
+  model->attached<ProductIndex>() = ProductIndex(aDoc, {});
+  return model;
+}
+
+Handle(TDocStd_Document) generateTestDocument(Handle(XCAFApp_Application) app,
+                                              size_t partCount) {
+  Handle(TDocStd_Document) aDoc;
+  app->NewDocument("MDTV-XCAF", aDoc);
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(aDoc->Main());
+  Handle(XCAFDoc_ColorTool) colorTool =
+      XCAFDoc_DocumentTool::ColorTool(aDoc->Main());
+
+  Quantity_Color const palette[] = {
+      Quantity_NOC_STEELBLUE, Quantity_NOC_GOLDENROD, Quantity_NOC_FIREBRICK,
+      Quantity_NOC_SEAGREEN, Quantity_NOC_SLATEGRAY, Quantity_NOC_ORCHID};
+  size_t const paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+  TopoDS_Shape const cylinder = BRepPrimAPI_MakeCylinder(0.3, 1.0).Shape();
+  int const side = static_cast<int>(std::ceil(std::cbrt(double(partCount))));
+  for (size_t i = 0; i < partCount; ++i) {
+    gp_Trsf placement;
+    placement.SetTranslation(gp_Vec(double(i % side), double(i / side % side),
+                                     double(i / side / side) * 1.5));
+    // Copies the geometry, so that every part is meshed and drawn on its own.
+    TopoDS_Shape const part =
+        BRepBuilderAPI_Transform(cylinder, placement, true).Shape();
+
+    TDF_Label const label = shapeTool->AddShape(part, false);
+    colorTool->SetColor(label, palette[i % paletteSize], XCAFDoc_ColorGen);
+  }
+  return aDoc;
+}
@@ -1,11 +1,39 @@
 #ifndef OCCTUTILITIES_HPP
 #define OCCTUTILITIES_HPP
+#include "ModelRegistry.hpp"
 #include "ViewerContext.hpp"
+#include "ViewerStats.hpp"
 #include "staircase.hpp"
+#include <opencascade/Poly_Triangulation.hxx>
+#include <opencascade/TopoDS_Face.hxx>
 
 std::optional<Handle(TDocStd_Document)>
 readInto(std::function<Handle(TDocStd_Document)()> aNewDoc,
-         std::istream &fromStream);
+         std::istream &fromStream, ViewerStats *stats = nullptr);
+
+/**
+ * Reads a STEP file like readInto(), but transfers its roots concurrently.
+ *
+ * Roots are split into at most maxPartitions partitions, no more than the
+ * worker pool can run at once, and never apart from roots they share a
+ * product with; a file whose roots all share products is transferred
+ * serially. Each partition is transferred into its own temporary document
+ * by a reader that parses its own copy of the content, and the results are
+ * merged into one document with their assembly structure, names and colors.
+ * Parsing is repeated per partition, so parse time and peak memory grow
+ * with the partition count, and this only pays off for files with several
+ * heavy independent top-level products. Must not be called from the main
+ * thread.
+ *
+ * @param aNewDoc Creates the result and temporary documents.
+ * @param content The STEP file content.
+ * @param maxPartitions Upper bound on the number of concurrent transfers.
+ * @param stats Receives the read and transfer phase timings (optional).
+ */
+std::optional<Handle(TDocStd_Document)>
+readIntoParallel(std::function<Handle(TDocStd_Document)()> aNewDoc,
+                 std::string const &content, size_t maxPartitions,
+                 ViewerStats *stats = nullptr);
 
 /**
  * Recursively prints the hierarchy of labels from a TDF_Label tree.
@@ -17,9 +45,78 @@ void printLabels(TDF_Label const &label, int level = 0);
 
 void readStepFile(
     Handle(XCAFApp_Application) app, std::string stepFileStr,
-    std::function<void(std::optional<Handle(TDocStd_Document)>)> callback);
+    std::function<void(std::optional<Handle(TDocStd_Document)>)> callback,
+    ViewerStats *stats = nullptr, size_t transferPartitions = 0);
 
 std::vector<TopoDS_Shape> getShapesFromDoc(Handle(TDocStd_Document) const aDoc);
 std::optional<Quantity_Color> getShapeColor(Handle(TDocStd_Document) const aDoc,
                                             TopoDS_Shape const shape);
+
+/**
+ * Triangulates a shape with the same parameters AIS uses for its default
+ * drawer, so that displaying it later does not mesh it again. New
+ * triangulations of large parts are reordered by MeshOptimizer. Shapes
+ * that share faces must not be meshed concurrently; lazy models serialize
+ * them through their mesh groups.
+ *
+ * @param shape The shape to triangulate.
+ */
+void meshShape(TopoDS_Shape const &shape);
+
+/**
+ * Computes the missing normals of a shape's triangulations. meshShape()
+ * does this for the triangulations it makes, so that drawing and reading
+ * them later never writes to them.
+ */
+void computeNormals(TopoDS_Shape const &shape);
+
+/**
+ * Triangulates the parts of a model again if they were dropped after its
+ * last use. Takes the model's exclusive triangulation lock if it does; must
+ * not be called from the main thread. Like buildModel(), it leaves every
+ * triangulation with normals, so viewers only ever read them.
+ */
+void ensureMeshed(LoadedModel &model);
+
+/**
+ * Calls body(face, triangulation, location) for every face of a shape that
+ * has a triangulation.
+ */
+void forEachTriangulation(
+    TopoDS_Shape const &shape,
+    std::function<void(TopoDS_Face const &, Handle(Poly_Triangulation) const &,
+                       TopLoc_Location const &)> const &body);
+
+/**
+ * Collects the displayable parts of a document and triangulates them.
+ *
+ * @param key The content key the model is registered under.
+ * @param aDoc The transferred XCAF document.
+ * @param stats Receives the traversal and mesh phase timings (optional).
+ */
+std::shared_ptr<LoadedModel> buildModel(ModelKey const &key,
+                                        Handle(TDocStd_Document) aDoc,
+                                        ViewerStats *stats = nullptr);
+
+/**
+ * Collects the branches of a document for lazy display: the components of
+ * top-level assemblies and the top-level shapes that are not assemblies,
+ * with their bounding boxes. Nothing is triangulated.
+ *
+ * @param key The content key the model is registered under.
+ * @param aDoc The transferred XCAF document.
+ * @param stats Receives the traversal phase timing (optional).
+ */
+std::shared_ptr<LoadedModel> buildLazyModel(ModelKey const &key,
+                                            Handle(TDocStd_Document) aDoc,
+                                            ViewerStats *stats = nullptr);
+/**
+ * Creates a document of small colored cylinders on a grid, for benchmarking
+ * scenes with many parts without a STEP file.
+ *
+ * @param app The application that owns the new document.
+ * @param partCount Number of top-level parts.
+ */
+Handle(TDocStd_Document) generateTestDocument(Handle(XCAFApp_Application) app,
+                                              size_t partCount);
 #endif
@@ -0,0 +1,258 @@
+#include "PartIndex.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Distance at which a ray enters a box, by the slab test.
+bool rayEntry(gp_Lin const &ray, Bnd_Box const &box, double &entry) {
+  if (box.IsVoid()) { return false; }
+  double lo[3], hi[3];
+  box.Get(lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]);
+  double const origin[3] = {ray.Location().X(), ray.Location().Y(),
+                            ray.Location().Z()};
+  double const direction[3] = {ray.Direction().X(), ray.Direction().Y(),
+                               ray.Direction().Z()};
+
+  double near = 0.0;
+  double far = std::numeric_limits<double>::max();
+  for (int axis = 0; axis < 3; ++axis) {
+    if (std::abs(direction[axis]) < 1e-12) {
+      if (origin[axis] < lo[axis] || origin[axis] > hi[axis]) { return false; }
+      continue;
+    }
+    double t0 = (lo[axis] - origin[axis]) / direction[axis];
+    double t1 = (hi[axis] - origin[axis]) / direction[axis];
+    if (t0 > t1) { std::swap(t0, t1); }
+    near = std::max(near, t0);
+    far = std::min(far, t1);
+    if (near > far) { return false; }
+  }
+  entry = near;
+  return true;
+}
+
+bool isOutside(Bnd_Box const &box, std::vector<gp_Pln> const &planes) {
+  if (box.IsVoid()) { return true; }
+  double xmin, ymin, zmin, xmax, ymax, zmax;
+  box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+  for (gp_Pln const &plane : planes) {
+    double a, b, c, d;
+    plane.Coefficients(a, b, c, d);
+    // The corner furthest along the normal is inside if any corner is.
+    double const x = a >= 0.0 ? xmax : xmin;
+    double const y = b >= 0.0 ? ymax : ymin;
+    double const z = c >= 0.0 ? zmax : zmin;
+    if (a * x + b * y + c * z + d < 0.0) { return true; }
+  }
+  return false;
+}
+
+} // namespace
+
+PartIndex::PartIndex(std::vector<Bnd_Box> const &boxes)
+    : boxes(boxes), order(boxes.size()), leafOf(boxes.size(), -1),
+      visible(boxes.size(), true) {
+  TRACE_SCOPE("PartIndex::build");
+  if (boxes.empty()) { return; }
+
+  std::vector<gp_Pnt> centers(boxes.size());
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    order[i] = int(i);
+    if (!boxes[i].IsVoid()) {
+      double xmin, ymin, zmin, xmax, ymax, zmax;
+      boxes[i].Get(xmin, ymin, zmin, xmax, ymax, zmax);
+      centers[i].SetCoord(0.5 * (xmin + xmax), 0.5 * (ymin + ymax),
+                          0.5 * (zmin + zmax));
+    }
+  }
+  nodes.reserve(4 * boxes.size() / LeafSize + 1);
+  build(centers, 0, int(boxes.size()), -1);
+}
+
+int PartIndex::build(std::vector<gp_Pnt> const &centers, int first, int count,
+                     int parent) {
+  int const index = int(nodes.size());
+  nodes.emplace_back();
+  nodes[index].parent = parent;
+
+  if (count <= LeafSize) {
+    nodes[index].first = first;
+    nodes[index].count = count;
+    for (int i = first; i < first + count; ++i) {
+      leafOf[order[i]] = index;
+      nodes[index].box.Add(boxes[order[i]]);
+    }
+    return index;
+  }
+
+  // Median split of the centers along their longest extent.
+  Bnd_Box centerBox;
+  for (int i = first; i < first + count; ++i) { centerBox.Add(centers[order[i]]); }
+  double xmin, ymin, zmin, xmax, ymax, zmax;
+  centerBox.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+  double const extents[3] = {xmax - xmin, ymax - ymin, zmax - zmin};
+  int const axis = int(std::max_element(extents, extents + 3) - extents) + 1;
+
+  int const half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count, [&centers, axis](int a, int b) {
+                     return centers[a].Coord(axis) < centers[b].Coord(axis);
+                   });
+  int const left = build(centers, first, half, index);
+  int const right = build(centers, first + half, count - half, index);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  nodes[index].box = nodes[left].box;
+  nodes[index].box.Add(nodes[right].box);
+  return index;
+}
+
+void PartIndex::setVisible(size_t part, bool value) {
+  if (part >= visible.size() || visible[part] == value) { return; }
+  visible[part] = value;
+  refit(leafOf[part]);
+}
+
+void PartIndex::setVisible(std::vector<size_t> const &parts, bool value) {
+  for (size_t part : parts) {
+    if (part < visible.size()) { visible[part] = value; }
+  }
+  // Paths to the root overlap; past a few parts one sweep is cheaper.
+  if (parts.size() * 8 < visible.size()) {
+    for (size_t part : parts) {
+      if (part < visible.size()) { refit(leafOf[part]); }
+    }
+  } else {
+    refitAll();
+  }
+}
+
+bool PartIndex::isVisible(size_t part) const {
+  return part < visible.size() && visible[part];
+}
+
+Bnd_Box const &PartIndex::partBox(size_t part) const { return boxes[part]; }
+
+Bnd_Box PartIndex::visibleBox() const {
+  return nodes.empty() ? Bnd_Box() : nodes.front().box;
+}
+
+void PartIndex::refit(int node) {
+  Node &leaf = nodes[node];
+  leaf.box.SetVoid();
+  for (int i = leaf.first; i < leaf.first + leaf.count; ++i) {
+    if (visible[order[i]]) { leaf.box.Add(boxes[order[i]]); }
+  }
+  for (int n = leaf.parent; n >= 0; n = nodes[n].parent) {
+    Bnd_Box box = nodes[nodes[n].left].box;
+    box.Add(nodes[nodes[n].right].box);
+    nodes[n].box = box;
+  }
+}
+
+void PartIndex::refitAll() {
+  // Children come after their parent, as the tree is built depth first.
+  for (int n = int(nodes.size()) - 1; n >= 0; --n) {
+    Node &node = nodes[n];
+    if (!node.isLeaf()) {
+      Bnd_Box box = nodes[node.left].box;
+      box.Add(nodes[node.right].box);
+      node.box = box;
+      continue;
+    }
+    node.box.SetVoid();
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      if (visible[order[i]]) { node.box.Add(boxes[order[i]]); }
+    }
+  }
+}
+
+std::vector<size_t> PartIndex::partsInBox(Bnd_Box const &box) const {
+  std::vector<size_t> result;
+  if (nodes.empty()) { return result; }
+  std::vector<int> stack{0};
+  while (!stack.empty()) {
+    Node const &node = nodes[stack.back()];
+    stack.pop_back();
+    if (node.box.IsOut(box)) { continue; }
+    if (!node.isLeaf()) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      int const part = order[i];
+      if (visible[part] && !boxes[part].IsOut(box)) { result.push_back(part); }
+    }
+  }
+  return result;
+}
+
+std::vector<size_t>
+PartIndex::partsInRegion(std::vector<gp_Pln> const &planes) const {
+  std::vector<size_t> result;
+  if (nodes.empty()) { return result; }
+  std::vector<int> stack{0};
+  while (!stack.empty()) {
+    Node const &node = nodes[stack.back()];
+    stack.pop_back();
+    if (isOutside(node.box, planes)) { continue; }
+    if (!node.isLeaf()) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+      continue;
+    }
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      int const part = order[i];
+      if (visible[part] && !isOutside(boxes[part], planes)) {
+        result.push_back(part);
+      }
+    }
+  }
+  return result;
+}
+
+int PartIndex::nearestPart(gp_Lin const &ray, double *distance) const {
+  int best = -1;
+  double bestEntry = std::numeric_limits<double>::max();
+  double entry = 0.0;
+  if (nodes.empty() || !rayEntry(ray, nodes.front().box, entry)) { return best; }
+
+  std::vector<std::pair<double, int>> stack{{entry, 0}};
+  while (!stack.empty()) {
+    auto const [nodeEntry, index] = stack.back();
+    stack.pop_back();
+    if (nodeEntry >= bestEntry) { continue; }
+    Node const &node = nodes[index];
+
+    if (node.isLeaf()) {
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        int const part = order[i];
+        if (visible[part] && rayEntry(ray, boxes[part], entry) &&
+            entry < bestEntry) {
+          best = part;
+          bestEntry = entry;
+        }
+      }
+      continue;
+    }
+
+    // The nearer child goes on top, so that it is searched first.
+    double leftEntry = 0.0;
+    double rightEntry = 0.0;
+    bool const hitLeft = rayEntry(ray, nodes[node.left].box, leftEntry);
+    bool const hitRight = rayEntry(ray, nodes[node.right].box, rightEntry);
+    if (hitLeft && hitRight && leftEntry < rightEntry) {
+      stack.push_back({rightEntry, node.right});
+      stack.push_back({leftEntry, node.left});
+    } else {
+      if (hitLeft) { stack.push_back({leftEntry, node.left}); }
+      if (hitRight) { stack.push_back({rightEntry, node.right}); }
+    }
+  }
+  if (distance && best >= 0) { *distance = bestEntry; }
+  return best;
+}
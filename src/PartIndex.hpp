@@ -0,0 +1,79 @@
+#ifndef PARTINDEX_HPP
+#define PARTINDEX_HPP
+#include <opencascade/Bnd_Box.hxx>
+#include <opencascade/gp_Lin.hxx>
+#include <opencascade/gp_Pln.hxx>
+#include <vector>
+
+/**
+ * Bounding volume hierarchy over the world-space boxes of a model's parts,
+ * for bounds and region queries that do not visit every part.
+ *
+ * Every node also keeps the box of its visible parts. Hiding or showing a
+ * part refits the nodes above it, so queries only ever find visible parts
+ * and visibleBox() is the root's box. The tree is built on the background
+ * worker; every viewer works on its own copy.
+ */
+class PartIndex {
+public:
+  static int const LeafSize = 4;
+
+  PartIndex() = default;
+  /** @param boxes World-space box of every part, by part index. */
+  explicit PartIndex(std::vector<Bnd_Box> const &boxes);
+
+  size_t size() const { return leafOf.size(); }
+  size_t nodeCount() const { return nodes.size(); }
+
+  void setVisible(size_t part, bool visible);
+  /** Refits once for all of the parts, instead of once per part. */
+  void setVisible(std::vector<size_t> const &parts, bool visible);
+  bool isVisible(size_t part) const;
+  Bnd_Box const &partBox(size_t part) const;
+  /** Box of all visible parts; void if there are none. */
+  Bnd_Box visibleBox() const;
+
+  /** Visible parts whose boxes intersect a world-space box. */
+  std::vector<size_t> partsInBox(Bnd_Box const &box) const;
+
+  /**
+   * Visible parts whose boxes intersect a convex region.
+   *
+   * @param planes Bounding planes whose normals point into the region.
+   */
+  std::vector<size_t> partsInRegion(std::vector<gp_Pln> const &planes) const;
+
+  /**
+   * The visible part whose box a ray enters first, or -1 if it misses all.
+   * Boxes the ray starts in count as entered at distance 0.
+   *
+   * @param ray The ray.
+   * @param distance Receives the distance along the ray (optional).
+   */
+  int nearestPart(gp_Lin const &ray, double *distance = nullptr) const;
+
+private:
+  struct Node {
+    Bnd_Box box;
+    int parent = -1;
+    // Children for inner nodes; the range of order for leaves.
+    int left = -1;
+    int right = -1;
+    int first = 0;
+    int count = 0;
+
+    bool isLeaf() const { return left < 0; }
+  };
+
+  std::vector<Node> nodes;
+  std::vector<Bnd_Box> boxes;
+  std::vector<int> order;  // parts, grouped by leaf
+  std::vector<int> leafOf; // leaf node of every part
+  std::vector<bool> visible;
+
+  int build(std::vector<gp_Pnt> const &centers, int first, int count, int parent);
+  void refit(int node);
+  void refitAll();
+};
+
+#endif // PARTINDEX_HPP
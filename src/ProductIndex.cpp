@@ -0,0 +1,157 @@
+#include "ProductIndex.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+#include <opencascade/BRepBndLib.hxx>
+#include <opencascade/Bnd_Box.hxx>
+#include <opencascade/TCollection_AsciiString.hxx>
+#include <opencascade/TDF_LabelIndexedMap.hxx>
+#include <opencascade/TDF_LabelSequence.hxx>
+#include <opencascade/TDataStd_Name.hxx>
+#include <opencascade/TopLoc_Location.hxx>
+#include <opencascade/TopTools_DataMapOfShapeInteger.hxx>
+#include <opencascade/XCAFDoc_DocumentTool.hxx>
+#include <opencascade/XCAFDoc_ShapeTool.hxx>
+#include <unordered_map>
+
+namespace {
+
+bool labelName(TDF_Label const &label, std::string &name) {
+  Handle(TDataStd_Name) attribute;
+  if (label.IsNull() || !label.FindAttribute(TDataStd_Name::GetID(), attribute)) {
+    return false;
+  }
+  // Converts to UTF-8.
+  name = TCollection_AsciiString(attribute->Get()).ToCString();
+  return true;
+}
+
+} // namespace
+
+ProductIndex::ProductIndex(Handle(TDocStd_Document) const &doc,
+                           std::vector<TopoDS_Shape> const &parts) {
+  TRACE_SCOPE("ProductIndex::build");
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+
+  TopTools_DataMapOfShapeInteger partOfShape;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    if (!parts[i].IsNull() && !partOfShape.IsBound(parts[i])) {
+      partOfShape.Bind(parts[i], int(i));
+    }
+  }
+
+  // The occurrence label, the product it refers to and the placement in
+  // world space of every node; only needed while building.
+  std::vector<TDF_Label> labels{TDF_Label()};
+  std::vector<int> productOf{0};
+  std::vector<TopLoc_Location> locations{TopLoc_Location()};
+  TDF_LabelIndexedMap products;
+
+  parents.push_back(-1);
+  std::unordered_map<std::string, uint32_t> nameIndices;
+  auto addName = [this, &nameIndices](std::string const &name) {
+    auto const [it, added] = nameIndices.emplace(name, uint32_t(names.size()));
+    if (added) { names.push_back(name); }
+    return it->second;
+  };
+  nameOf.push_back(addName(""));
+
+  // Breadth first, so that the children of every node are appended together.
+  for (size_t node = 0; node < parents.size(); ++node) {
+    TDF_LabelSequence children;
+    if (node == 0) {
+      shapeTool->GetFreeShapes(children);
+    } else {
+      TDF_Label const product = products.FindKey(productOf[node]);
+      if (shapeTool->IsAssembly(product)) {
+        shapeTool->GetComponents(product, children, false);
+      }
+    }
+
+    firstChildren.push_back(uint32_t(parents.size()));
+    childCounts.push_back(uint32_t(children.Length()));
+    for (TDF_LabelSequence::Iterator it(children); it.More(); it.Next()) {
+      TDF_Label const &label = it.Value();
+      TDF_Label product = label;
+      TopLoc_Location location = locations[node];
+      if (XCAFDoc_ShapeTool::IsReference(label)) {
+        XCAFDoc_ShapeTool::GetReferredShape(label, product);
+        location = location * XCAFDoc_ShapeTool::GetLocation(label);
+      }
+
+      std::string name;
+      if (!labelName(label, name)) { labelName(product, name); }
+
+      parents.push_back(int32_t(node));
+      labels.push_back(label);
+      productOf.push_back(products.Add(product));
+      locations.push_back(location);
+      nameOf.push_back(addName(name));
+    }
+  }
+
+  size_t const count = parents.size();
+  std::vector<uint32_t> occurrences(products.Extent() + 1, 0);
+  for (size_t node = 1; node < count; ++node) { ++occurrences[productOf[node]]; }
+  instanceCounts.resize(count, 1);
+  partOf.resize(count, -1);
+  for (size_t node = 1; node < count; ++node) {
+    instanceCounts[node] = occurrences[productOf[node]];
+    TopoDS_Shape const shape = shapeTool->GetShape(labels[node]);
+    if (!shape.IsNull() && partOfShape.IsBound(shape)) {
+      partOf[node] = partOfShape.Find(shape);
+    }
+  }
+
+  // Every product that is not an assembly is bounded once, in its own space.
+  std::vector<Bnd_Box> productBoxes(products.Extent() + 1);
+  std::vector<TopoDS_Shape> productShapes(products.Extent() + 1);
+  for (int i = 1; i <= products.Extent(); ++i) {
+    if (!shapeTool->IsAssembly(products.FindKey(i))) {
+      productShapes[i] = shapeTool->GetShape(products.FindKey(i));
+    }
+  }
+  WorkerPool::parallelFor(productShapes.size(), [&](size_t i) {
+    if (!productShapes[i].IsNull()) {
+      BRepBndLib::Add(productShapes[i], productBoxes[i], true);
+    }
+  });
+
+  // Leaves place the box of their product; the rest bound their children,
+  // which always come after them.
+  std::vector<Bnd_Box> nodeBoxes(count);
+  boxes.resize(count, {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+  for (size_t node = count; node-- > 0;) {
+    if (childCounts[node] == 0) {
+      Bnd_Box const &box = productBoxes[productOf[node]];
+      if (!box.IsVoid()) {
+        nodeBoxes[node] = locations[node].IsIdentity()
+                              ? box
+                              : box.Transformed(locations[node].Transformation());
+      }
+    } else {
+      for (uint32_t child = firstChildren[node];
+           child < firstChildren[node] + childCounts[node]; ++child) {
+        nodeBoxes[node].Add(nodeBoxes[child]);
+      }
+    }
+    if (!nodeBoxes[node].IsVoid()) {
+      double xmin, ymin, zmin, xmax, ymax, zmax;
+      nodeBoxes[node].Get(xmin, ymin, zmin, xmax, ymax, zmax);
+      boxes[node] = {float(xmin), float(ymin), float(zmin),
+                     float(xmax), float(ymax), float(zmax)};
+    }
+  }
+}
+
+size_t ProductIndex::byteSize() const {
+  size_t bytes = parents.capacity() * sizeof(int32_t) +
+                 firstChildren.capacity() * sizeof(uint32_t) +
+                 childCounts.capacity() * sizeof(uint32_t) +
+                 instanceCounts.capacity() * sizeof(uint32_t) +
+                 partOf.capacity() * sizeof(int32_t) +
+                 nameOf.capacity() * sizeof(uint32_t) +
+                 boxes.capacity() * sizeof(std::array<float, 6>);
+  for (std::string const &name : names) { bytes += sizeof(name) + name.capacity(); }
+  return bytes;
+}
@@ -0,0 +1,62 @@
+#ifndef PRODUCTINDEX_HPP
+#define PRODUCTINDEX_HPP
+#include <array>
+#include <cstdint>
+#include <opencascade/TDocStd_Document.hxx>
+#include <opencascade/TopoDS_Shape.hxx>
+#include <string>
+#include <vector>
+
+/**
+ * Flat copy of a document's product structure, for tree views that page
+ * through the children of one node at a time without touching OCAF.
+ *
+ * Node 0 is the document; its children are the free shapes, and every
+ * assembly occurrence has its components as children. Nodes are numbered
+ * breadth first, so the children of a node are one contiguous range. Names
+ * are shared through one table. Each node has the number of occurrences of
+ * its product in the whole structure, its box in world space, and the
+ * index of the model part made from its label, if any.
+ */
+class ProductIndex {
+public:
+  ProductIndex() = default;
+
+  /**
+   * Walks the assembly structure of a document. Boxes of the products are
+   * computed on the worker pool, from their triangulations where present;
+   * must not be called from the main thread.
+   *
+   * @param doc The XCAF document.
+   * @param parts Part shapes of the model, to map nodes to part indices.
+   */
+  ProductIndex(Handle(TDocStd_Document) const &doc,
+               std::vector<TopoDS_Shape> const &parts);
+
+  size_t size() const { return parents.size(); }
+  size_t nameCount() const { return names.size(); }
+  size_t byteSize() const;
+
+  int32_t parent(uint32_t node) const { return parents[node]; }
+  uint32_t firstChild(uint32_t node) const { return firstChildren[node]; }
+  uint32_t childCount(uint32_t node) const { return childCounts[node]; }
+  uint32_t instanceCount(uint32_t node) const { return instanceCounts[node]; }
+  int32_t part(uint32_t node) const { return partOf[node]; }
+  std::string const &name(uint32_t node) const { return names[nameOf[node]]; }
+  uint32_t nameIndex(uint32_t node) const { return nameOf[node]; }
+  std::string const &nameAt(uint32_t index) const { return names[index]; }
+  /** xmin, ymin, zmin, xmax, ymax, zmax; all zero for empty nodes. */
+  std::array<float, 6> const &box(uint32_t node) const { return boxes[node]; }
+
+private:
+  std::vector<int32_t> parents;
+  std::vector<uint32_t> firstChildren;
+  std::vector<uint32_t> childCounts;
+  std::vector<uint32_t> instanceCounts;
+  std::vector<int32_t> partOf;
+  std::vector<uint32_t> nameOf;
+  std::vector<std::array<float, 6>> boxes;
+  std::vector<std::string> names;
+};
+
+#endif // PRODUCTINDEX_HPP
@@ -0,0 +1,39 @@
+#include "QualityGovernor.hpp"
+#include <algorithm>
+#include <cmath>
+
+void QualityGovernor::setTargetFrameTime(double ms) {
+  target = std::max(ms, 0.0);
+  if (target == 0.0) { restore(); }
+}
+
+double QualityGovernor::targetFrameTime() const { return target; }
+
+void QualityGovernor::frameRendered(double frameTime, bool interacting,
+                                    double now) {
+  if (interacting) { lastInteraction = now; }
+  if (target <= 0.0 || !interacting || frameTime <= 0.0) { return; }
+
+  // Interaction that keeps up at full quality is left alone.
+  if (!reduced) {
+    reduced = frameTime > target;
+    return;
+  }
+
+  // Leaves the scale alone near the target, so it does not oscillate.
+  double const ratio = target / frameTime;
+  if (ratio < 0.9 || ratio > 1.25) {
+    interactiveScale = std::clamp(float(interactiveScale * std::sqrt(ratio)),
+                                  MinScale, 1.0f);
+  }
+}
+
+bool QualityGovernor::isIdle(double now) const {
+  return now - lastInteraction >= IdleDelay;
+}
+
+double QualityGovernor::idleIn(double now) const {
+  return std::max(lastInteraction + IdleDelay - now, 0.0);
+}
+
+void QualityGovernor::restore() { reduced = false; }
@@ -0,0 +1,45 @@
+#ifndef QUALITYGOVERNOR_HPP
+#define QUALITYGOVERNOR_HPP
+
+/**
+ * Decides the render scale of a view from its frame times. Once a frame
+ * drawn while the camera moves misses the target, quality is reduced and the
+ * scale follows the frame time towards the target: the number of pixels is
+ * assumed to be proportional to the cost of a frame. Once the camera was still for IdleDelay, full quality
+ * comes back. The last scale used during interaction is kept for the next
+ * one, so that it does not have to be found again.
+ */
+class QualityGovernor {
+public:
+  static constexpr float MinScale = 0.5f;
+  static constexpr double IdleDelay = 250.0; // ms
+
+  /** @param ms Frame time to aim for while moving, 0 to never reduce. */
+  void setTargetFrameTime(double ms);
+  double targetFrameTime() const;
+
+  /**
+   * @param frameTime How long rendering the frame took, in milliseconds.
+   * @param interacting Whether the camera moved for this frame.
+   * @param now Current time, in milliseconds.
+   */
+  void frameRendered(double frameTime, bool interacting, double now);
+
+  /** Whether the camera has not moved for at least IdleDelay. */
+  bool isIdle(double now) const;
+  /** Milliseconds until isIdle() holds, if the camera does not move. */
+  double idleIn(double now) const;
+  void restore();
+
+  bool isReduced() const { return reduced; }
+  /** Render resolution scale for the next frame. */
+  float scale() const { return reduced ? interactiveScale : 1.0f; }
+
+private:
+  double target = 1000.0 / 30.0;
+  float interactiveScale = 1.0f;
+  bool reduced = false;
+  double lastInteraction = 0.0;
+};
+
+#endif // QUALITYGOVERNOR_HPP
@@ -0,0 +1,250 @@
+#include "QuantizedPart.hpp"
+#include "OCCTUtilities.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <opencascade/Bnd_Box.hxx>
+#include <opencascade/Graphic3d_AspectFillArea3d.hxx>
+#include <opencascade/Graphic3d_ShaderAttribute.hxx>
+#include <opencascade/Graphic3d_ShaderObject.hxx>
+#include <opencascade/Prs3d_ShadingAspect.hxx>
+#include <opencascade/StdPrs_ToolTriangulatedShape.hxx>
+#include <opencascade/StdSelect_BRepSelectionTool.hxx>
+
+namespace {
+
+// Every vertex is two normalized byte vectors. occVertex holds the high bytes
+// of the position and the first normal component, occQuantLow the low bytes
+// and the second normal component.
+char const *const VertexShader = R"(
+THE_ATTRIBUTE vec4 occQuantLow;
+THE_SHADER_OUT vec3 viewNormal;
+
+vec3 decodeOctahedral(vec2 e) {
+  vec2 f = e * 2.0 - vec2(1.0);
+  vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+  if (n.z < 0.0) { n.xy = (vec2(1.0) - abs(n.yx)) * sign(n.xy); }
+  return normalize(n);
+}
+
+void main() {
+  vec3 high = floor(occVertex.xyz * 255.0 + 0.5);
+  vec3 low = floor(occQuantLow.xyz * 255.0 + 0.5);
+  vec4 position = vec4((high * 256.0 + low) / 65535.0, 1.0);
+
+  // The model matrix only scales and translates, so world normals are stored.
+  vec3 normal = decodeOctahedral(vec2(occVertex.w, occQuantLow.w));
+  viewNormal = (occWorldViewMatrix * vec4(normal, 0.0)).xyz;
+  gl_Position = occProjectionMatrix * occWorldViewMatrix * occModelWorldMatrix * position;
+}
+)";
+
+char const *const FragmentShader = R"(
+THE_SHADER_IN vec3 viewNormal;
+
+void main() {
+  float light = 0.3 + 0.7 * abs(normalize(viewNormal).z);
+  occSetFragColor(vec4(occColor.rgb * light, occColor.a));
+}
+)";
+
+// Like GLSL sign(), so that decoding here matches the shader.
+double signum(double x) { return x > 0.0 ? 1.0 : (x < 0.0 ? -1.0 : 0.0); }
+
+Standard_Byte toByte(double unit) {
+  return Standard_Byte(std::lround(std::clamp(unit, 0.0, 1.0) * 255.0));
+}
+
+// Projects a unit vector onto the octahedron and unfolds it into [0, 1]^2.
+void encodeOctahedral(gp_Dir const &n, Standard_Byte &u, Standard_Byte &v) {
+  double const l1 = std::abs(n.X()) + std::abs(n.Y()) + std::abs(n.Z());
+  double x = n.X() / l1;
+  double y = n.Y() / l1;
+  if (n.Z() < 0.0) {
+    double const folded = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+    y = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+    x = folded;
+  }
+  u = toByte(x * 0.5 + 0.5);
+  v = toByte(y * 0.5 + 0.5);
+}
+
+gp_Dir decodeOctahedral(Standard_Byte u, Standard_Byte v) {
+  double x = u / 255.0 * 2.0 - 1.0;
+  double y = v / 255.0 * 2.0 - 1.0;
+  double const z = 1.0 - std::abs(x) - std::abs(y);
+  if (z < 0.0) {
+    double const folded = (1.0 - std::abs(y)) * signum(x);
+    y = (1.0 - std::abs(x)) * signum(y);
+    x = folded;
+  }
+  return gp_Dir(x, y, z);
+}
+
+} // namespace
+
+Handle(QuantizedPart) QuantizedPart::create(ModelPart const &part,
+                                            double positionTolerance,
+                                            double normalTolerance) {
+  TRACE_SCOPE("QuantizedPart");
+
+  // World-space triangles of all faces, with outward normals.
+  std::vector<gp_Pnt> points;
+  std::vector<gp_Dir> normals;
+  std::vector<int> triangles;
+  Bnd_Box box;
+  forEachTriangulation(part.shape, [&](TopoDS_Face const &face,
+                                       Handle(Poly_Triangulation) const &tri,
+                                       TopLoc_Location const &location) {
+    // meshShape() computed the normals; the shared triangulation is only
+    // read here, so missing ones go into a copy.
+    Handle(Poly_Triangulation) withNormals = tri;
+    if (!withNormals->HasNormals()) {
+      withNormals = new Poly_Triangulation(tri);
+      StdPrs_ToolTriangulatedShape::ComputeNormals(face, withNormals);
+    }
+    gp_Trsf const trsf = location.Transformation();
+    bool const reversed = face.Orientation() == TopAbs_REVERSED;
+
+    int const base = int(points.size());
+    for (int n = 1; n <= tri->NbNodes(); ++n) {
+      gp_Dir normal = withNormals->Normal(n).Transformed(trsf);
+      if (reversed) { normal.Reverse(); }
+      points.push_back(tri->Node(n).Transformed(trsf));
+      normals.push_back(normal);
+      box.Add(points.back());
+    }
+    for (int t = 1; t <= tri->NbTriangles(); ++t) {
+      int a, b, c;
+      tri->Triangle(t).Get(a, b, c);
+      if (reversed) { std::swap(b, c); }
+      triangles.insert(triangles.end(), {base + a - 1, base + b - 1, base + c - 1});
+    }
+  });
+  if (triangles.empty()) { return Handle(QuantizedPart)(); }
+
+  // One scale for all axes, since the local transformation cannot stretch.
+  gp_Pnt const origin = box.CornerMin();
+  gp_Pnt const corner = box.CornerMax();
+  double const extent = std::max({corner.X() - origin.X(), corner.Y() - origin.Y(),
+                                  corner.Z() - origin.Z()});
+  if (extent <= 0.0) { return Handle(QuantizedPart)(); }
+
+  Handle(QuantizedPart) quantized = new QuantizedPart(part);
+
+  Graphic3d_Attribute const attributes[] = {
+      {Graphic3d_TOA_POS, Graphic3d_TOD_VEC4UB},
+      {Graphic3d_TOA_CUSTOM, Graphic3d_TOD_VEC4UB}};
+  quantized->vertices = new Graphic3d_Buffer(Graphic3d_Buffer::DefaultAllocator());
+  if (!quantized->vertices->Init(int(points.size()), attributes, 2)) {
+    return Handle(QuantizedPart)();
+  }
+
+  Graphic3d_Vec4ub *data =
+      reinterpret_cast<Graphic3d_Vec4ub *>(quantized->vertices->ChangeData());
+  double const cosTolerance = std::cos(normalTolerance * M_PI / 180.0);
+  double worstCos = 1.0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    Graphic3d_Vec4ub &high = data[2 * i];
+    Graphic3d_Vec4ub &low = data[2 * i + 1];
+
+    gp_XYZ const unit = (points[i].XYZ() - origin.XYZ()) / extent;
+    gp_XYZ decoded;
+    for (int axis = 1; axis <= 3; ++axis) {
+      long const q = std::lround(std::clamp(unit.Coord(axis), 0.0, 1.0) * 65535.0);
+      high[axis - 1] = Standard_Byte(q >> 8);
+      low[axis - 1] = Standard_Byte(q & 0xFF);
+      decoded.SetCoord(axis, origin.Coord(axis) + q / 65535.0 * extent);
+    }
+    quantized->maxPositionError =
+        std::max(quantized->maxPositionError, (decoded - points[i].XYZ()).Modulus());
+
+    encodeOctahedral(normals[i], high.w(), low.w());
+    worstCos = std::min(worstCos, decodeOctahedral(high.w(), low.w()).Dot(normals[i]));
+  }
+  quantized->maxNormalError = std::acos(std::clamp(worstCos, -1.0, 1.0)) * 180.0 / M_PI;
+  if (quantized->maxPositionError > positionTolerance || worstCos < cosTolerance) {
+    return Handle(QuantizedPart)();
+  }
+
+  quantized->indices = new Graphic3d_IndexBuffer(Graphic3d_Buffer::DefaultAllocator());
+  bool const initialized =
+      points.size() <= 65536
+          ? quantized->indices->Init<unsigned short>(int(triangles.size()))
+          : quantized->indices->Init<unsigned int>(int(triangles.size()));
+  if (!initialized) { return Handle(QuantizedPart)(); }
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    quantized->indices->SetIndex(int(i), triangles[i]);
+  }
+
+  gp_Trsf decode;
+  decode.SetScale(gp::Origin(), extent);
+  decode.SetTranslationPart(origin.XYZ());
+  quantized->SetLocalTransformation(decode);
+  return quantized;
+}
+
+size_t QuantizedPart::gpuBytes() const {
+  return size_t(vertices->NbElements) * vertices->Stride +
+         size_t(indices->NbElements) * indices->Stride;
+}
+
+size_t QuantizedPart::fullPrecisionBytes() const {
+  return size_t(vertices->NbElements) * 2 * sizeof(Graphic3d_Vec3) +
+         size_t(indices->NbElements) * indices->Stride;
+}
+
+void QuantizedPart::Compute(Handle(PrsMgr_PresentationManager) const &,
+                            Handle(Prs3d_Presentation) const &prs,
+                            Standard_Integer const mode) {
+  if (mode != 1) { return; }
+
+  Handle(Graphic3d_AspectFillArea3d) aspect =
+      new Graphic3d_AspectFillArea3d(*myDrawer->ShadingAspect()->Aspect());
+  aspect->SetShadingModel(Graphic3d_TypeOfShadingModel_Unlit);
+  // An own color or transparency replaces the part's from the file.
+  Quantity_Color const color = HasColor()   ? myDrawer->Color()
+                               : part.color ? *part.color
+                                            : myDrawer->ShadingAspect()->Color();
+  aspect->SetInteriorColor(Quantity_ColorRGBA(color, float(1.0 - Transparency())));
+  if (IsTransparent()) { aspect->SetAlphaMode(Graphic3d_AlphaMode_BlendAuto); }
+  aspect->SetShaderProgram(shaderProgram());
+
+  Handle(Graphic3d_Group) group = prs->NewGroup();
+  group->SetGroupPrimitivesAspect(aspect);
+  group->AddPrimitiveArray(Graphic3d_TOPA_TRIANGLES, indices, vertices,
+                           Handle(Graphic3d_BoundBuffer)(), Standard_False);
+  // The group cannot measure byte positions; they span the unit cube.
+  group->SetMinMaxValues(0.0, 0.0, 0.0, 1.0, 1.0, 1.0);
+}
+
+void QuantizedPart::ComputeSelection(Handle(SelectMgr_Selection) const &selection,
+                                     Standard_Integer const mode) {
+  if (mode != 0) { return; }
+
+  // Sensitive entities live in the quantized space, like the presentation.
+  TopoDS_Shape const local = part.shape.Moved(
+      TopLoc_Location(LocalTransformation().Inverted()), Standard_False);
+  StdSelect_BRepSelectionTool::Load(
+      selection, this, local, TopAbs_SHAPE,
+      StdPrs_ToolTriangulatedShape::GetDeflection(part.shape, myDrawer),
+      myDrawer->DeviationAngle(), Standard_False);
+}
+
+Handle(Graphic3d_ShaderProgram) const &QuantizedPart::shaderProgram() {
+  static Handle(Graphic3d_ShaderProgram) const program = [] {
+    Handle(Graphic3d_ShaderProgram) program = new Graphic3d_ShaderProgram();
+    program->SetId("staircase_quantized");
+    program->AttachShader(
+        Graphic3d_ShaderObject::CreateFromSource(Graphic3d_TOS_VERTEX, VertexShader));
+    program->AttachShader(
+        Graphic3d_ShaderObject::CreateFromSource(Graphic3d_TOS_FRAGMENT, FragmentShader));
+
+    Graphic3d_ShaderAttributeList attributes;
+    attributes.Append(new Graphic3d_ShaderAttribute("occVertex", Graphic3d_TOA_POS));
+    attributes.Append(new Graphic3d_ShaderAttribute("occQuantLow", Graphic3d_TOA_CUSTOM));
+    program->SetVertexAttributes(attributes);
+    return program;
+  }();
+  return program;
+}
@@ -0,0 +1,67 @@
+#ifndef QUANTIZEDPART_HPP
+#define QUANTIZEDPART_HPP
+#include "ModelRegistry.hpp"
+#include <opencascade/AIS_InteractiveObject.hxx>
+#include <opencascade/Graphic3d_Buffer.hxx>
+#include <opencascade/Graphic3d_IndexBuffer.hxx>
+#include <opencascade/Graphic3d_ShaderProgram.hxx>
+#include <optional>
+
+/**
+ * Displays one part from a compact vertex buffer of 8 bytes per vertex
+ * instead of 24: positions quantized to 16 bits per axis within the part's
+ * bounding box, and normals octahedron-encoded into 8 bits per component.
+ * Indices are 16-bit whenever the part has fewer than 65536 vertices.
+ *
+ * The bytes are decoded in a small unlit shader with a head light; the box
+ * offset and scale are the object's local transformation. The shader has no
+ * specular term and ignores the view's lights and materials, so a quantized
+ * part looks flatter than the same part shaded with Phong. Picking uses the
+ * triangulation of the shape as usual.
+ *
+ * The part must be triangulated before create() is called.
+ */
+class QuantizedPart : public AIS_InteractiveObject {
+  DEFINE_STANDARD_RTTI_INLINE(QuantizedPart, AIS_InteractiveObject)
+public:
+  /**
+   * Quantizes a part, or returns a null handle if it has no triangles or
+   * decoding it would be off by more than the tolerances.
+   *
+   * @param part The part to quantize.
+   * @param positionTolerance Largest position error, in model units.
+   * @param normalTolerance Largest normal error, in degrees.
+   */
+  static Handle(QuantizedPart) create(ModelPart const &part,
+                                      double positionTolerance,
+                                      double normalTolerance);
+
+  size_t gpuBytes() const;
+  /** Bytes the same triangles take with float positions and normals. */
+  size_t fullPrecisionBytes() const;
+  double positionError() const { return maxPositionError; }
+  double normalError() const { return maxNormalError; }
+
+  Standard_Boolean AcceptDisplayMode(Standard_Integer const mode) const override {
+    return mode == 1;
+  }
+
+  void Compute(Handle(PrsMgr_PresentationManager) const &prsMgr,
+               Handle(Prs3d_Presentation) const &prs,
+               Standard_Integer const mode) override;
+  void ComputeSelection(Handle(SelectMgr_Selection) const &selection,
+                        Standard_Integer const mode) override;
+
+private:
+  QuantizedPart(ModelPart const &part) : part(part) {}
+
+  ModelPart part;
+  Handle(Graphic3d_Buffer) vertices;
+  Handle(Graphic3d_IndexBuffer) indices;
+  double maxPositionError = 0.0;
+  double maxNormalError = 0.0;
+
+  static Handle(Graphic3d_ShaderProgram) const &shaderProgram();
+};
+
+#endif // QUANTIZEDPART_HPP
@@ -1,28 +1,105 @@
 #include "StaircaseViewController.hpp"
 #include "ViewerContext.hpp"
 #include "OCCTUtilities.hpp"
+#include "WorkerPool.hpp"
 #include "staircase.hpp"
 #include <AIS_ViewCube.hxx>
 #include <Wasm_Window.hxx>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <unordered_set>
+#include <opencascade/AIS_ConnectedInteractive.hxx>
 #include <opencascade/AIS_InteractiveContext.hxx>
 #include <opencascade/AIS_Shape.hxx>
+#include <opencascade/BRepPrimAPI_MakeCylinder.hxx>
+#include <opencascade/Image_PixMap.hxx>
+#include <opencascade/OpenGl_Context.hxx>
+#include <opencascade/OpenGl_FrameStats.hxx>
 #include <opencascade/OpenGl_GraphicDriver.hxx>
 #include <opencascade/Prs3d_DatumAspect.hxx>
+#include <opencascade/Prs3d_Drawer.hxx>
 #include <opencascade/TDocStd_Document.hxx>
 #include <opencascade/TopoDS_Shape.hxx>
 #include <opencascade/V3d_View.hxx>
+#include <opencascade/gp.hxx>
+
+// Forwards mouse and pen pointer events of a canvas, relative to the canvas.
+// Its client rect is cached until the canvas resizes or the page scrolls, so
+// events do not force a layout. Touch stays with the touch events, which
+// carry the gestures. The types passed on are EMSCRIPTEN_EVENT_MOUSEDOWN (5),
+// EMSCRIPTEN_EVENT_MOUSEUP (6) and EMSCRIPTEN_EVENT_MOUSEMOVE (8).
+EM_JS(void, jsAttachPointerInput, (char const *selector, void *controller), {
+  var canvas = document.querySelector(UTF8ToString(selector));
+  if (!canvas) { return; }
+
+  var rect = null;
+  var invalidate = function() { rect = null; };
+  var send = function(type, event) {
+    if (event.pointerType === "touch") { return; }
+    if (!rect) { rect = canvas.getBoundingClientRect(); }
+    var modifiers = (event.ctrlKey ? 1 : 0) | (event.shiftKey ? 2 : 0) |
+                    (event.altKey ? 4 : 0) | (event.metaKey ? 8 : 0);
+    _staircase_pointer_event(controller, type, event.clientX - rect.left,
+                             event.clientY - rect.top, event.button,
+                             event.buttons, modifiers, event.timeStamp);
+  };
+  var listeners = {
+    pointerdown: function(event) {
+      // Keeps moves and the release coming when the pointer leaves the canvas.
+      canvas.setPointerCapture(event.pointerId);
+      send(5, event);
+    },
+    pointermove: function(event) { send(8, event); },
+    pointerup: function(event) { send(6, event); },
+    pointercancel: function(event) { send(6, event); },
+  };
+  for (var type in listeners) { canvas.addEventListener(type, listeners[type]); }
+  var resizeObserver = new ResizeObserver(invalidate);
+  resizeObserver.observe(canvas);
+  window.addEventListener("resize", invalidate);
+  window.addEventListener("scroll", invalidate, {capture: true, passive: true});
+
+  Module._staircasePointerInput = Module._staircasePointerInput || new Map();
+  Module._staircasePointerInput.set(controller, function() {
+    for (var type in listeners) { canvas.removeEventListener(type, listeners[type]); }
+    resizeObserver.disconnect();
+    window.removeEventListener("resize", invalidate);
+    window.removeEventListener("scroll", invalidate, {capture: true});
+  });
+});
 
-// Update canvas bounding rectangle.
-EM_JS(void, jsUpdateBoundingClientRect, (),
-      { Module._myCanvasRect = Module.canvas.getBoundingClientRect(); });
-
-// Get canvas bounding top.
-EM_JS(int, jsGetBoundingClientTop, (),
-      { return Math.round(Module._myCanvasRect.top); });
+EM_JS(void, jsDetachPointerInput, (void *controller), {
+  var inputs = Module._staircasePointerInput;
+  if (inputs && inputs.has(controller)) {
+    inputs.get(controller)();
+    inputs.delete(controller);
+  }
+});
+
+extern "C" EMSCRIPTEN_KEEPALIVE void
+staircase_pointer_event(StaircaseViewController *controller, int eventType,
+                        double x, double y, int button, int buttons,
+                        int modifiers, double timeStamp) {
+  EmscriptenMouseEvent event = {};
+  event.timestamp = timeStamp;
+  event.targetX = int(std::lround(x));
+  event.targetY = int(std::lround(y));
+  event.button = static_cast<unsigned short>(button);
+  event.buttons = static_cast<unsigned short>(buttons);
+  event.ctrlKey = (modifiers & 1) != 0;
+  event.shiftKey = (modifiers & 2) != 0;
+  event.altKey = (modifiers & 4) != 0;
+  event.metaKey = (modifiers & 8) != 0;
+  controller->onPointerEvent(eventType, event);
+}
 
-// Get canvas bounding left.
-EM_JS(int, jsGetBoundingClientLeft, (),
-      { return Math.round(Module._myCanvasRect.left); });
+StaircaseViewController::~StaircaseViewController() {
+  jsDetachPointerInput(this);
+  if (qualityIdleTimer != 0) { emscripten_clear_timeout(qualityIdleTimer); }
+  if (refineTimer != 0) { emscripten_clear_timeout(refineTimer); }
+}
 
 void StaircaseViewController::initWindow() {
   debugOut("StaircaseViewController::initWindow()");
@@ -75,11 +152,11 @@ void StaircaseViewController::initWindow() {
         eventType, event);
   };
 
+  // Presses, moves and releases come as pointer events.
+  jsAttachPointerInput(canvasTarget, this);
+
   // clang-format off
   emscripten_set_resize_callback     (windowTarget, this, useCapture, resizeCallback);
-  emscripten_set_mousedown_callback  (canvasTarget, this, useCapture, mouseCallback);
-  emscripten_set_mouseup_callback    (windowTarget, this, useCapture, mouseCallback);
-  emscripten_set_mousemove_callback  (windowTarget, this, useCapture, mouseCallback);
   emscripten_set_dblclick_callback   (canvasTarget, this, useCapture, mouseCallback);
   emscripten_set_click_callback      (canvasTarget, this, useCapture, mouseCallback);
   emscripten_set_mouseenter_callback (canvasTarget, this, useCapture, mouseCallback);
@@ -153,11 +230,20 @@ bool StaircaseViewController::initViewer() {
   view->ChangeRenderingParams().Resolution =
       (unsigned int)96.0 * devicePixelRatio + 0.5;
   view->ChangeRenderingParams().ToShowStats = false;
+  view->ChangeRenderingParams().CollectedStats =
+      Graphic3d_RenderingParams::PerfCounters(
+          Graphic3d_RenderingParams::PerfCounters_Basic |
+          Graphic3d_RenderingParams::PerfCounters_Groups |
+          Graphic3d_RenderingParams::PerfCounters_Triangles |
+          Graphic3d_RenderingParams::PerfCounters_EstimMem);
   view->ChangeRenderingParams().StatsTextAspect = textAspect->Aspect();
   view->ChangeRenderingParams().StatsTextHeight = textAspect->Height();
   view->SetWindow(aWindow);
 
   aisContext = new AIS_InteractiveContext(aViewer);
+  // Builds the BVHs of newly loaded selections on a thread of OCCT's own,
+  // instead of on the first pick.
+  aisContext->MainSelector()->SetToPrebuildBVH(Standard_True, 1);
 
   if (viewCube.IsNull()) {
     initScene();
@@ -215,46 +301,700 @@ void StaircaseViewController::initScene() {
 void StaircaseViewController::removeAllObjects() {
   if (aisContext.IsNull()) { return; }
 
+  bool const hadObjects =
+      !activeShapes.empty() || lazyScene || !batchedParts.IsNull();
   for (auto const &shape : activeShapes) {
     aisContext->Remove(shape, false);
     aisContext->Erase(shape, false);
   }
-  if (!activeShapes.empty()) {
-    activeShapes.clear();
-    this->updateView();
+  activeShapes.clear();
+  displayedModel.reset();
+  batchedSource.clear();
+  partIndex = PartIndex();
+  partOf.clear();
+  hiddenWhileMoving.clear();
+  smallParts.clear();
+  prototypes = 0;
+  instances = 0;
+  quantized = 0;
+  quantizedGpuBytes = 0;
+  quantizedFullBytes = 0;
+  lazyScene.reset();
+  hiddenLines.reset();
+  erasedForLines.clear();
+  linesShown = false;
+  clearFeatureEdges();
+  occlusionBaker.reset();
+  gpuHovered.Nullify();
+  if (gpuPicker) { gpuPicker->clear(); }
+  if (!batchedParts.IsNull()) {
+    aisContext->Remove(batchedParts, false);
+    batchedParts.Nullify();
   }
+  if (hadObjects) { this->updateView(); }
+}
+
+namespace {
+
+// Diagonal of all parts of a model; quantization tolerances are relative to
+// it.
+double modelSize(LoadedModel &model) {
+  Bnd_Box const box = model.attached<PartIndex>().visibleBox();
+  return box.IsVoid() ? 0.0 : std::sqrt(box.SquareExtent());
 }
-void StaircaseViewController::initStepFile(Handle(TDocStd_Document) aDoc) {
-  debugOut("StaircaseViewController::initStepFile(Handle(TDocStd_Document))");
 
-  if (aDoc.IsNull() || aisContext.IsNull()) {
-    std::cerr << "No document or AIS context." << std::endl;
+} // namespace
+
+void StaircaseViewController::initStepFile(
+    std::shared_ptr<LoadedModel> const &model,
+    std::vector<Handle(AIS_InteractiveObject)> const &prebuilt) {
+  debugOut("StaircaseViewController::initStepFile(std::shared_ptr<LoadedModel>)");
+  TRACE_SCOPE("initStepFile");
+
+  if (!model || aisContext.IsNull()) {
+    std::cerr << "No model or AIS context." << std::endl;
+    return;
   }
 
   removeAllObjects();
+  firstPick = -1.0;
+  firstModelFrame = -1.0;
+  firstModelFramePending = true;
+
+  if (model->key.lazy) {
+    debugOut("lazy branches: ", model->attached<LazyBranches>().branches.size());
+    lazyScene = std::make_unique<LazyScene>(aisContext, model);
+    fitAllObjects(true);
+    return;
+  }
+
+  debugOut("model->parts.size(): ", model->parts.size());
+  partIndex = model->attached<PartIndex>();
+  displayedModel = model;
+
+  if (batchParts) {
+    batchedSource = model->parts;
+    batchedParts = new BatchedParts(batchedSource, ambientOcclusion);
+    debugOut("batchedParts->batchCount(): ", batchedParts->batchCount());
+    aisContext->Display(batchedParts, AIS_SHADED_MODE, 0, Standard_False);
+    startHiddenLines();
+    requestFeatureEdges();
+    startOcclusion();
+    fitAllObjects(true);
+    return;
+  }
+
+  if (instanceParts) {
+    displayInstanced(model->parts);
+  } else {
+    bool const usePrebuilt = prebuilt.size() == model->parts.size();
+    debugOut("prebuilt objects: ", usePrebuilt ? prebuilt.size() : 0);
+    double const size = modelSize(*model);
+    for (size_t i = 0; i < model->parts.size(); ++i) {
+      Handle(AIS_InteractiveObject) object =
+          usePrebuilt ? prebuilt[i] : createPartObject(model->parts[i], size);
+      aisContext->Display(object, AIS_SHADED_MODE, 0, Standard_False);
+      activeShapes.push_back(object);
+
+      if (auto compact = Handle(QuantizedPart)::DownCast(object)) {
+        ++quantized;
+        quantizedGpuBytes += compact->gpuBytes();
+        quantizedFullBytes += compact->fullPrecisionBytes();
+      }
+    }
+  }
+
+  for (size_t i = 0; i < activeShapes.size(); ++i) {
+    partOf[activeShapes[i].get()] = i;
+  }
+
+  // Parts under 2% of the model size are hidden while moving.
+  double const minSize = 0.02 * modelSize(*model);
+  for (size_t i = 0; i < activeShapes.size(); ++i) {
+    Bnd_Box const &box = partIndex.partBox(i);
+    if (!box.IsVoid() && std::sqrt(box.SquareExtent()) < minSize) {
+      smallParts.push_back(i);
+    }
+  }
+
+  if (gpuPicking) {
+    if (!gpuPicker) { gpuPicker = std::make_unique<GpuPicker>(view); }
+    gpuPicker->setParts(model->parts);
+  }
+
+  startHiddenLines();
+  requestFeatureEdges();
+  fitAllObjects(true);
+}
+
+Handle(AIS_InteractiveObject)
+StaircaseViewController::createPartObject(ModelPart const &part,
+                                          double size) const {
+  if (quantizeParts) {
+    Handle(QuantizedPart) compact = QuantizedPart::create(
+        part, quantizePositionTolerance * size, quantizeNormalTolerance);
+    if (!compact.IsNull()) {
+      compact->SetDisplayMode(AIS_SHADED_MODE);
+      return compact;
+    }
+  }
+
+  Handle(AIS_Shape) aisShape = new AIS_Shape(part.shape);
+  if (part.color.has_value()) { aisShape->SetColor(part.color.value()); }
+  aisShape->SetDisplayMode(AIS_SHADED_MODE);
+  return aisShape;
+}
+
+std::vector<Handle(AIS_InteractiveObject)>
+StaircaseViewController::prebuildObjects(LoadedModel &model) const {
+  std::vector<Handle(AIS_InteractiveObject)> objects;
+  if (!prebuildSelection || model.key.lazy || batchParts || instanceParts) {
+    return objects;
+  }
+  TRACE_SCOPE("prebuildObjects");
+
+  // The objects are in no context until the main thread displays them, so
+  // their selection is computed against a detached drawer with the defaults
+  // meshShape() used, never against the context's. It only reads the
+  // existing triangulations; Display() links the context's drawer.
+  static Handle(Prs3d_Drawer) const detachedDrawer = [] {
+    Handle(Prs3d_Drawer) drawer = new Prs3d_Drawer();
+    drawer->SetupOwnDefaults();
+    drawer->SetAutoTriangulation(Standard_False);
+    return drawer;
+  }();
+
+  objects.resize(model.parts.size());
+  double const size = modelSize(model);
+  std::shared_lock<std::shared_mutex> lock(model.triangulationMutex);
+  WorkerPool::parallelFor(model.parts.size(), [&](size_t i) {
+    Handle(AIS_InteractiveObject) object = createPartObject(model.parts[i], size);
+    object->Attributes()->SetLink(detachedDrawer);
+    // Display finds selection mode 0 computed and only activates it.
+    object->RecomputePrimitives(0);
+    for (auto const &entity : object->Selection(0)->Entities()) {
+      entity->BaseSensitive()->BVH();
+    }
+    objects[i] = object;
+  });
+  return objects;
+}
+
+void StaircaseViewController::setPrebuildSelection(bool value) {
+  prebuildSelection = value;
+}
+
+void StaircaseViewController::displayInstanced(
+    std::vector<ModelPart> const &parts) {
+  TRACE_SCOPE("displayInstanced");
+
+  // Parts are instances of each other if they only differ in location.
+  using InstanceKey = std::tuple<TopoDS_TShape const *, TopAbs_Orientation,
+                                 bool, Standard_Real, Standard_Real, Standard_Real>;
+  std::map<InstanceKey, std::vector<size_t>> groups;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    auto const &color = parts[i].color;
+    groups[{parts[i].shape.TShape().get(), parts[i].shape.Orientation(),
+            color.has_value(), color ? color->Red() : 0.0,
+            color ? color->Green() : 0.0, color ? color->Blue() : 0.0}]
+        .push_back(i);
+  }
+
+  activeShapes.resize(parts.size());
+  for (auto const &[key, members] : groups) {
+    ModelPart const &first = parts[members.front()];
+    if (members.size() == 1) {
+      Handle(AIS_Shape) aisShape = new AIS_Shape(first.shape);
+      if (first.color.has_value()) { aisShape->SetColor(first.color.value()); }
+      // Also the mode applyVisibility() shows it in again.
+      aisShape->SetDisplayMode(AIS_SHADED_MODE);
+      aisContext->Display(aisShape, AIS_SHADED_MODE, 0, Standard_False);
+      activeShapes[members.front()] = aisShape;
+      continue;
+    }
+
+    // The prototype is not displayed itself; its presentation is computed
+    // once and connected into every instance.
+    Handle(AIS_Shape) prototype =
+        new AIS_Shape(first.shape.Located(TopLoc_Location()));
+    if (first.color.has_value()) { prototype->SetColor(first.color.value()); }
+    prototype->SetDisplayMode(AIS_SHADED_MODE);
+    ++prototypes;
+
+    for (size_t member : members) {
+      Handle(AIS_ConnectedInteractive) instance = new AIS_ConnectedInteractive();
+      instance->Connect(prototype,
+                        parts[member].shape.Location().Transformation());
+      instance->SetDisplayMode(AIS_SHADED_MODE);
+      aisContext->Display(instance, AIS_SHADED_MODE, 0, Standard_False);
+      activeShapes[member] = instance;
+      ++instances;
+    }
+  }
+}
+
+void StaircaseViewController::setInstanceParts(bool value) {
+  instanceParts = value;
+}
+
+size_t StaircaseViewController::prototypeCount() const { return prototypes; }
+
+size_t StaircaseViewController::instanceCount() const { return instances; }
+
+void StaircaseViewController::setQuantizeParts(bool value,
+                                               double positionTolerance,
+                                               double normalTolerance) {
+  quantizeParts = value;
+  quantizePositionTolerance = positionTolerance;
+  quantizeNormalTolerance = normalTolerance;
+}
+
+size_t StaircaseViewController::quantizedCount() const { return quantized; }
+
+size_t StaircaseViewController::quantizedBytes() const {
+  return quantizedGpuBytes;
+}
+
+size_t StaircaseViewController::fullPrecisionBytes() const {
+  return quantizedFullBytes;
+}
+
+void StaircaseViewController::updateLazyScene() {
+  if (lazyScene && !view.IsNull() && lazyScene->update(view)) {
+    this->updateView();
+  }
+}
+
+LazyScene *StaircaseViewController::getLazyScene() const {
+  return lazyScene.get();
+}
+
+void StaircaseViewController::setHiddenLineMode(bool enabled, bool showHidden) {
+  hiddenLineMode = enabled;
+  showHiddenLines = showHidden;
+  if (!enabled) {
+    showShadedParts();
+    hiddenLines.reset();
+  } else if (hiddenLines) {
+    hiddenLines->setShowHidden(showHidden);
+  } else {
+    startHiddenLines();
+  }
+  this->updateView();
+}
+
+bool StaircaseViewController::isHiddenLineMode() const { return hiddenLineMode; }
+
+void StaircaseViewController::updateHiddenLines() {
+  if (!hiddenLines || view.IsNull()) { return; }
+  bool changed = hiddenLines->update(view);
+  if (hiddenLines->isShowing() != linesShown) {
+    if (linesShown) {
+      showShadedParts();
+    } else {
+      hideShadedParts();
+    }
+    changed = true;
+  }
+  if (changed) { this->updateView(); }
+}
+
+HiddenLineView const *StaircaseViewController::getHiddenLines() const {
+  return hiddenLines.get();
+}
+
+void StaircaseViewController::startHiddenLines() {
+  if (!hiddenLineMode || !displayedModel) { return; }
+  hiddenLines = std::make_unique<HiddenLineView>(aisContext, displayedModel);
+  hiddenLines->setShowHidden(showHiddenLines);
+  hiddenLines->setShapes(visiblePartShapes());
+}
+
+std::vector<TopoDS_Shape> StaircaseViewController::visiblePartShapes() const {
+  std::vector<TopoDS_Shape> shapes;
+  if (!displayedModel) { return shapes; }
+  for (size_t part = 0; part < displayedModel->parts.size(); ++part) {
+    if (partIndex.isVisible(part)) {
+      shapes.push_back(displayedModel->parts[part].shape);
+    }
+  }
+  return shapes;
+}
 
-  std::vector<TopoDS_Shape> shapes = getShapesFromDoc(aDoc);
-  debugOut("shapes.size(): ", shapes.size());
+void StaircaseViewController::setFeatureEdges(bool enabled, double angle) {
+  if (enabled == featureEdges && angle == featureEdgeAngle) { return; }
+  featureEdges = enabled;
+  featureEdgeAngle = angle;
+  clearFeatureEdges();
+  if (enabled) { requestFeatureEdges(); }
+  this->updateView();
+}
 
-  for (auto const &shape : shapes) {
+bool StaircaseViewController::isShowingFeatureEdges() const {
+  return !edgeBatches.empty();
+}
 
-    Handle(AIS_Shape) aisShape = new AIS_Shape(shape);
-    aisContext->SetDisplayMode(aisShape, AIS_SHADED_MODE, Standard_True);
-    aisContext->Display(aisShape, Standard_True);
+void StaircaseViewController::requestFeatureEdges() {
+  if (!featureEdges || !displayedModel) { return; }
+
+  auto model = displayedModel;
+  auto inbox = edgeInbox;
+  double const angle = featureEdgeAngle;
+  WorkerPool::submit([model, inbox, angle]() {
+    TRACE_SCOPE("extractFeatureEdges");
+    double const start = emscripten_get_now();
+    std::shared_ptr<PartEdges const> edges;
+    FeatureEdgeCache &cache = model->attached<FeatureEdgeCache>();
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      if (cache.angle == angle) { edges = cache.edges; }
+    }
+    if (!edges) {
+      auto extracted = std::make_shared<PartEdges>(model->parts.size());
+      {
+        std::shared_lock<std::shared_mutex> lock(model->triangulationMutex);
+        WorkerPool::parallelFor(model->parts.size(), [&](size_t i) {
+          (*extracted)[i] = extractFeatureEdges(model->parts[i].shape,
+                                                angle * M_PI / 180.0);
+        });
+      }
+      edges = extracted;
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      cache.angle = angle;
+      cache.edges = edges;
+    }
 
-    std::optional<Quantity_Color> optColor = getShapeColor(aDoc, shape);
+    std::lock_guard<std::mutex> lock(inbox->mutex);
+    inbox->model = model;
+    inbox->angle = angle;
+    inbox->edges = edges;
+    inbox->milliseconds = emscripten_get_now() - start;
+  });
+}
+
+void StaircaseViewController::updateFeatureEdges() {
+  std::shared_ptr<LoadedModel> model;
+  std::shared_ptr<PartEdges const> edges;
+  double angle = 0.0;
+  double milliseconds = 0.0;
+  {
+    std::lock_guard<std::mutex> lock(edgeInbox->mutex);
+    if (!edgeInbox->edges) { return; }
+    model = std::move(edgeInbox->model);
+    edges = std::move(edgeInbox->edges);
+    angle = edgeInbox->angle;
+    milliseconds = edgeInbox->milliseconds;
+  }
+  // Results for an earlier model or setting.
+  if (!featureEdges || model != displayedModel || angle != featureEdgeAngle ||
+      edges->size() != partCount()) {
+    return;
+  }
 
-    if (optColor.has_value()) {
-      Quantity_Color aColor = optColor.value();
-      aisContext->SetColor(aisShape, aColor, Standard_True);
+  TRACE_SCOPE("displayFeatureEdges");
+  clearFeatureEdges();
+  edgeTime = milliseconds;
+  edgeBatches = FeatureEdgeBatch::create(edges);
+  for (auto const &batch : edgeBatches) {
+    for (size_t part = batch->firstPart();
+         part < batch->firstPart() + batch->partCount(); ++part) {
+      if (!partIndex.isVisible(part)) { batch->setPartVisible(part, false); }
+    }
+    if (!linesShown) {
+      aisContext->Display(batch, AIS_WIREFRAME_MODE, -1, Standard_False);
     }
-    activeShapes.push_back(aisShape);
   }
+  this->updateView();
+}
+
+void StaircaseViewController::clearFeatureEdges() {
+  for (auto const &batch : edgeBatches) { aisContext->Remove(batch, Standard_False); }
+  edgeBatches.clear();
+}
+
+void StaircaseViewController::applyEdgeVisibility(std::vector<size_t> const &parts,
+                                                  bool visible) {
+  if (edgeBatches.empty()) { return; }
+  std::vector<bool> changed(edgeBatches.size(), false);
+  for (size_t part : parts) {
+    // Batches hold consecutive parts, in order.
+    auto const batch = std::upper_bound(
+        edgeBatches.begin(), edgeBatches.end(), part,
+        [](size_t part, Handle(FeatureEdgeBatch) const &batch) {
+          return part < batch->firstPart();
+        }) - 1;
+    (*batch)->setPartVisible(part, visible);
+    changed[batch - edgeBatches.begin()] = true;
+  }
+  for (size_t b = 0; b < edgeBatches.size(); ++b) {
+    if (changed[b]) { aisContext->Redisplay(edgeBatches[b], Standard_False); }
+  }
+}
+
+size_t StaircaseViewController::featureEdgeBatchCount() const {
+  return edgeBatches.size();
+}
+
+size_t StaircaseViewController::featureEdgeSegmentCount() const {
+  size_t count = 0;
+  for (auto const &batch : edgeBatches) { count += batch->segmentCount(); }
+  return count;
+}
+
+double StaircaseViewController::featureEdgeTime() const { return edgeTime; }
+
+void StaircaseViewController::setAmbientOcclusion(bool enabled, int rays) {
+  if (enabled == ambientOcclusion && rays == occlusionRays) { return; }
+  ambientOcclusion = enabled;
+  occlusionRays = rays;
+  occlusionBaker.reset();
+  if (!batchedParts.IsNull() && batchedParts->hasOcclusion() != enabled) {
+    rebuildBatches();
+  }
+  startOcclusion();
+  this->updateView();
+}
+
+void StaircaseViewController::startOcclusion() {
+  if (!ambientOcclusion || batchedParts.IsNull() || !displayedModel) { return; }
+  occlusionBaker = std::make_unique<OcclusionBaker>(displayedModel, occlusionRays);
+}
+
+void StaircaseViewController::updateAmbientOcclusion() {
+  if (!occlusionBaker || batchedParts.IsNull()) { return; }
+  std::vector<size_t> const parts = occlusionBaker->takeBaked();
+  if (parts.empty()) { return; }
+
+  TRACE_SCOPE("applyOcclusion");
+  applyOcclusion(parts);
+  this->updateView();
+}
+
+void StaircaseViewController::applyOcclusion(std::vector<size_t> const &parts) {
+  for (size_t part : parts) {
+    if (auto values = occlusionBaker->occlusion(part)) {
+      batchedParts->setPartOcclusion(part, *values);
+    }
+  }
+}
+
+OcclusionBaker const *StaircaseViewController::getOcclusionBaker() const {
+  return occlusionBaker.get();
+}
+
+void StaircaseViewController::hideShadedParts() {
+  for (auto const &object : activeShapes) {
+    if (aisContext->IsDisplayed(object)) {
+      aisContext->Erase(object, Standard_False);
+      erasedForLines.push_back(object);
+    }
+  }
+  if (!batchedParts.IsNull() && aisContext->IsDisplayed(batchedParts)) {
+    aisContext->Erase(batchedParts, Standard_False);
+    erasedForLines.push_back(batchedParts);
+  }
+  for (auto const &batch : edgeBatches) { aisContext->Erase(batch, Standard_False); }
+  linesShown = true;
+}
+
+void StaircaseViewController::showShadedParts() {
+  for (auto const &object : erasedForLines) {
+    aisContext->Display(object, AIS_SHADED_MODE, 0, Standard_False);
+  }
+  erasedForLines.clear();
+  for (auto const &batch : edgeBatches) {
+    aisContext->Display(batch, AIS_WIREFRAME_MODE, -1, Standard_False);
+  }
+  linesShown = false;
+}
+
+void StaircaseViewController::setBatchParts(bool value) { batchParts = value; }
+
+void StaircaseViewController::setPartVisible(size_t part, bool visible) {
+  setPartsVisible({static_cast<uint32_t>(part)}, visible);
+}
+
+void StaircaseViewController::setPartsVisible(std::vector<uint32_t> const &parts,
+                                              bool visible) {
+  TRACE_SCOPE("setPartsVisible");
+  std::vector<size_t> changed;
+  changed.reserve(parts.size());
+  for (uint32_t part : parts) {
+    if (part < partCount() && partIndex.isVisible(part) != visible) {
+      changed.push_back(part);
+    }
+  }
+  applyVisibility(changed, visible);
+  if (hiddenLines && !changed.empty()) {
+    hiddenLines->setShapes(visiblePartShapes());
+  }
+  this->updateView();
+}
+
+void StaircaseViewController::isolateParts(std::vector<uint32_t> const &parts) {
+  TRACE_SCOPE("isolateParts");
+  size_t const count = partCount();
+  std::vector<bool> keep(count, false);
+  for (uint32_t part : parts) {
+    if (part < count) { keep[part] = true; }
+  }
+  std::vector<size_t> shown;
+  std::vector<size_t> hidden;
+  for (size_t part = 0; part < count; ++part) {
+    if (keep[part] != partIndex.isVisible(part)) {
+      (keep[part] ? shown : hidden).push_back(part);
+    }
+  }
+  applyVisibility(hidden, false);
+  applyVisibility(shown, true);
+  if (hiddenLines && (!hidden.empty() || !shown.empty())) {
+    hiddenLines->setShapes(visiblePartShapes());
+  }
+  this->updateView();
+}
+
+size_t StaircaseViewController::partCount() const {
+  return batchedParts.IsNull() ? activeShapes.size() : batchedParts->partCount();
+}
+
+void StaircaseViewController::applyVisibility(std::vector<size_t> const &parts,
+                                              bool visible) {
+  if (parts.empty()) { return; }
+  // The erased parts come back first, so that the change applies to them.
+  if (linesShown) { showShadedParts(); }
+  partIndex.setVisible(parts, visible);
+  applyEdgeVisibility(parts, visible);
+
+  if (!batchedParts.IsNull()) {
+    for (size_t part : parts) { batchedParts->setPartVisible(part, visible); }
+    aisContext->RecomputeSelectionOnly(batchedParts);
+    return;
+  }
+
+  // Parts hidden by the governor would otherwise come back when it restores.
+  if (!hiddenWhileMoving.empty()) {
+    std::unordered_set<AIS_InteractiveObject const *> changed;
+    for (size_t part : parts) { changed.insert(activeShapes[part].get()); }
+    hiddenWhileMoving.erase(
+        std::remove_if(hiddenWhileMoving.begin(), hiddenWhileMoving.end(),
+                       [&changed](Handle(AIS_InteractiveObject) const &object) {
+                         return changed.count(object.get()) > 0;
+                       }),
+        hiddenWhileMoving.end());
+  }
+  for (size_t part : parts) {
+    if (visible) {
+      aisContext->Display(activeShapes[part], Standard_False);
+    } else {
+      aisContext->Erase(activeShapes[part], Standard_False);
+    }
+    if (gpuPicker) { gpuPicker->setPartVisible(part, visible); }
+  }
+}
+
+void StaircaseViewController::setPartsColor(std::vector<uint32_t> const &parts,
+                                            Quantity_Color const &color) {
+  TRACE_SCOPE("setPartsColor");
+  for (uint32_t part : parts) { applyPartColor(part, color); }
+  if (!batchedParts.IsNull()) { rebuildBatches(); }
+  this->updateView();
+}
+
+void StaircaseViewController::resetPartsColor(std::vector<uint32_t> const &parts) {
+  TRACE_SCOPE("resetPartsColor");
+  if (!displayedModel) { return; }
+  for (uint32_t part : parts) {
+    if (part < displayedModel->parts.size()) {
+      applyPartColor(part, displayedModel->parts[part].color);
+    }
+  }
+  if (!batchedParts.IsNull()) { rebuildBatches(); }
+  this->updateView();
+}
+
+void StaircaseViewController::applyPartColor(
+    uint32_t part, std::optional<Quantity_Color> const &color) {
+  if (part >= partCount()) { return; }
+  if (!batchedParts.IsNull()) {
+    batchedSource[part].color = color;
+    return;
+  }
+
+  Handle(AIS_InteractiveObject) const &object = ownObject(part);
+  if (color.has_value()) {
+    aisContext->SetColor(object, color.value(), Standard_False);
+  } else {
+    aisContext->UnsetColor(object, Standard_False);
+  }
+  // Its aspect is made in Compute() rather than taken from the drawer.
+  if (object->IsKind(STANDARD_TYPE(QuantizedPart))) {
+    aisContext->Redisplay(object, Standard_False);
+  }
+}
 
-  this->FitAllAuto(aisContext, view);
+void StaircaseViewController::setPartsTransparency(
+    std::vector<uint32_t> const &parts, double transparency) {
+  TRACE_SCOPE("setPartsTransparency");
+  if (!batchedParts.IsNull()) {
+    debugOut("Transparency is not supported for batched parts.");
+    return;
+  }
+  for (uint32_t part : parts) {
+    if (part >= activeShapes.size()) { continue; }
+    Handle(AIS_InteractiveObject) const &object = ownObject(part);
+    aisContext->SetTransparency(object, transparency, Standard_False);
+    if (object->IsKind(STANDARD_TYPE(QuantizedPart))) {
+      aisContext->Redisplay(object, Standard_False);
+    }
+  }
   this->updateView();
 }
 
+Handle(AIS_InteractiveObject) const &
+StaircaseViewController::ownObject(size_t part) {
+  Handle(AIS_InteractiveObject) &object = activeShapes[part];
+  if (!object->IsKind(STANDARD_TYPE(AIS_ConnectedInteractive))) { return object; }
+  // The next hidden line update erases the new object again.
+  if (linesShown) { showShadedParts(); }
+
+  // An instance draws its prototype's presentation, so a part that should
+  // look different needs an object of its own.
+  auto const hidden =
+      std::find(hiddenWhileMoving.begin(), hiddenWhileMoving.end(), object);
+  bool const shown = hidden != hiddenWhileMoving.end() ||
+                     aisContext->IsDisplayed(object);
+  if (hidden != hiddenWhileMoving.end()) { hiddenWhileMoving.erase(hidden); }
+  partOf.erase(object.get());
+  aisContext->Remove(object, Standard_False);
+  --instances;
+
+  object = createPartObject(displayedModel->parts[part], modelSize(*displayedModel));
+  partOf[object.get()] = part;
+  if (shown) { aisContext->Display(object, AIS_SHADED_MODE, 0, Standard_False); }
+  return object;
+}
+
+void StaircaseViewController::rebuildBatches() {
+  TRACE_SCOPE("rebuildBatches");
+  if (linesShown) { showShadedParts(); }
+  Handle(BatchedParts) rebuilt = new BatchedParts(batchedSource, ambientOcclusion);
+  for (size_t part = 0; part < rebuilt->partCount(); ++part) {
+    if (!batchedParts->isPartVisible(part)) { rebuilt->setPartVisible(part, false); }
+  }
+  aisContext->Remove(batchedParts, Standard_False);
+  batchedParts = rebuilt;
+  if (occlusionBaker) {
+    std::vector<size_t> parts(batchedParts->partCount());
+    std::iota(parts.begin(), parts.end(), size_t(0));
+    applyOcclusion(parts);
+  }
+  aisContext->Display(batchedParts, AIS_SHADED_MODE, 0, Standard_False);
+}
+
+size_t StaircaseViewController::batchCount() const {
+  return batchedParts.IsNull() ? 0 : batchedParts->batchCount();
+}
+
 void StaircaseViewController::setCanLoadNewFile(bool value) {
   std::lock_guard<std::mutex> lock(fileLoadMutex);
   _canLoadNewFile = value;
@@ -267,6 +1007,9 @@ bool StaircaseViewController::canLoadNewFile() {
 
 void StaircaseViewController::ProcessInput() {
   if (shouldRender && !view.IsNull()) {
+    // The next frame may move the camera; it should not pay for antialiasing.
+    if (idleRefined) { setIdleRefined(false); }
+
     // Schedule canvas redraw post user input, aligned with animation frame.
     if (++updateRequestCount == 1) {
       emscripten_async_call(onRedrawView, this, -1);
@@ -287,14 +1030,321 @@ void StaircaseViewController::updateView() {
 
 void StaircaseViewController::redrawView() {
   if (!view.IsNull()) {
+    // Before the request count is reset, so that this does not ask for
+    // another frame.
+    flushInput();
     updateRequestCount = 0;
+
+    TRACE_SCOPE("FlushViewEvents");
+    double const frameStart = emscripten_get_now();
     FlushViewEvents(aisContext, view, true);
+    double const frameEnd = emscripten_get_now();
+    frameTimes.push(frameEnd - frameStart);
+    if (firstModelFramePending) {
+      firstModelFrame = frameEnd - frameStart;
+      firstModelFramePending = false;
+    }
+
+    // The render time, not the interval between frames: that is bounded by
+    // the display's refresh rate and by how often input arrives.
+    Graphic3d_WorldViewProjState const cameraState =
+        view->Camera()->WorldViewProjState();
+    bool const moving = cameraState.IsChanged(lastCameraState);
+    lastCameraState = cameraState;
+    double const interval = lastFrameStart > 0.0 ? frameStart - lastFrameStart : 0.0;
+    qualityGovernor.frameRendered(frameEnd - frameStart, moving, frameEnd);
+    applyQuality();
+
+    if (!moving && !idleRefined && refineTimer == 0 && idleSamples > 0) {
+      refineTimer = emscripten_set_timeout(onIdleRefine, QualityGovernor::IdleDelay,
+                                           this);
+    }
+
+    if (lastFrameStart > 0.0) {
+      frameIntervals.push(interval);
+    }
+    lastFrameStart = frameStart;
+
+    if (flushedInputAt > 0.0) {
+      inputLatencies.push(emscripten_get_now() - flushedInputAt);
+      flushedInputAt = 0.0;
+    }
+    inputTimes.push(inputTime);
+    inputTime = 0.0;
   }
   setCanLoadNewFile(true);
 }
 
+void StaircaseViewController::applyQuality() {
+  Graphic3d_RenderingParams &params = view->ChangeRenderingParams();
+  if (!idleRefined && params.RenderResolutionScale != qualityGovernor.scale()) {
+    params.RenderResolutionScale = qualityGovernor.scale();
+  }
+  if (qualityGovernor.isReduced() == qualityReduced) { return; }
+
+  qualityReduced = qualityGovernor.isReduced();
+  if (qualityReduced) {
+    if (reduceShading) {
+      view->SetShadingModel(Graphic3d_TypeOfShadingModel_Gouraud);
+    }
+    if (reduceSmallParts) {
+      for (size_t part : smallParts) {
+        Handle(AIS_InteractiveObject) const &object = activeShapes[part];
+        if (!aisContext->IsDisplayed(object)) { continue; }
+        aisContext->Erase(object, Standard_False);
+        hiddenWhileMoving.push_back(object);
+      }
+    }
+    if (qualityIdleTimer == 0) {
+      qualityIdleTimer =
+          emscripten_set_timeout(onQualityIdle, QualityGovernor::IdleDelay, this);
+    }
+  } else {
+    view->SetShadingModel(Graphic3d_TypeOfShadingModel_Phong);
+    for (auto const &object : hiddenWhileMoving) {
+      aisContext->Display(object, AIS_SHADED_MODE, 0, Standard_False);
+    }
+    hiddenWhileMoving.clear();
+  }
+}
+
+void StaircaseViewController::onQualityIdle(void *controller) {
+  auto self = static_cast<StaircaseViewController *>(controller);
+  self->qualityIdleTimer = 0;
+  if (self->view.IsNull() || !self->qualityReduced) { return; }
+
+  double const now = emscripten_get_now();
+  if (!self->qualityGovernor.isIdle(now)) {
+    self->qualityIdleTimer = emscripten_set_timeout(
+        onQualityIdle, self->qualityGovernor.idleIn(now) + 1.0, self);
+    return;
+  }
+  self->qualityGovernor.restore();
+  self->applyQuality();
+  self->updateView();
+}
+
+void StaircaseViewController::setAdaptiveQuality(double targetFrameTime,
+                                                 bool cheapShading,
+                                                 bool hideSmallParts) {
+  qualityGovernor.setTargetFrameTime(targetFrameTime);
+  reduceShading = cheapShading;
+  reduceSmallParts = hideSmallParts;
+  if (!view.IsNull() && qualityReduced && !qualityGovernor.isReduced()) {
+    applyQuality();
+    this->updateView();
+  }
+}
+
+QualityGovernor const &StaircaseViewController::getQualityGovernor() const {
+  return qualityGovernor;
+}
+
+void StaircaseViewController::setIdleAntialiasing(int samples) {
+  idleSamples = std::max(samples, 0);
+  if (idleRefined) {
+    setIdleRefined(false);
+    this->updateView();
+  }
+}
+
+bool StaircaseViewController::isIdleRefined() const { return idleRefined; }
+
+void StaircaseViewController::setIdleRefined(bool value) {
+  idleRefined = value;
+  Graphic3d_RenderingParams &params = view->ChangeRenderingParams();
+  int const samples = std::min(idleSamples, maxMsaaSamples());
+  if (samples > 1) {
+    params.NbMsaaSamples = value ? samples : 0;
+  } else {
+    // WebGL 1 has no multisampled framebuffers: supersample instead.
+    params.RenderResolutionScale = value ? 2.0f : qualityGovernor.scale();
+  }
+}
+
+int StaircaseViewController::maxMsaaSamples() const {
+  auto aDriver = Handle(OpenGl_GraphicDriver)::DownCast(view->Viewer()->Driver());
+  if (aDriver.IsNull() || aDriver->GetSharedContext().IsNull()) { return 0; }
+  return aDriver->GetSharedContext()->MaxMsaaSamples();
+}
+
+void StaircaseViewController::warmUp() {
+  if (view.IsNull() || aisContext.IsNull() || displayedModel || lazyScene) {
+    return;
+  }
+  TRACE_SCOPE("warmUp");
+  double const start = emscripten_get_now();
+
+  ModelPart part{BRepPrimAPI_MakeCylinder(0.3, 1.0).Shape(),
+                 Quantity_Color(Quantity_NOC_STEELBLUE)};
+  meshShape(part.shape);
+  Handle(AIS_InteractiveObject) shaded;
+  if (batchParts) {
+    shaded = new BatchedParts({part}, ambientOcclusion);
+  } else {
+    // The stand-in is about one unit large.
+    shaded = createPartObject(part, 1.0);
+  }
+  Handle(AIS_Shape) lines = new AIS_Shape(part.shape);
+  aisContext->Display(shaded, AIS_SHADED_MODE, -1, Standard_False);
+  aisContext->Display(lines, AIS_WIREFRAME_MODE, -1, Standard_False);
+
+  // Only the image sees the stand-in; the canvas is not drawn until it is
+  // gone again.
+  Handle(Graphic3d_Camera) const camera = new Graphic3d_Camera(view->Camera());
+  view->FitAll(0.01, Standard_False);
+  Graphic3d_Vec2i size;
+  view->Window()->Size(size.x(), size.y());
+  Image_PixMap image;
+  if (!view->ToPixMap(image, std::max(size.x(), 1), std::max(size.y(), 1))) {
+    std::cerr << "Shader warm-up failed." << std::endl;
+  }
+  view->Camera()->Copy(camera);
+
+  aisContext->Remove(shaded, Standard_False);
+  aisContext->Remove(lines, Standard_False);
+  warmUpMs = emscripten_get_now() - start;
+  debugOut("warmUpMs: ", warmUpMs);
+  this->updateView();
+}
+
+double StaircaseViewController::warmUpTime() const { return warmUpMs; }
+
+double StaircaseViewController::firstModelFrameTime() const {
+  return firstModelFrame;
+}
+
+void StaircaseViewController::onIdleRefine(void *controller) {
+  auto self = static_cast<StaircaseViewController *>(controller);
+  self->refineTimer = 0;
+  if (self->view.IsNull() || self->idleRefined || self->idleSamples == 0) {
+    return;
+  }
+
+  double const now = emscripten_get_now();
+  if (self->qualityReduced || !self->qualityGovernor.isIdle(now)) {
+    self->refineTimer = emscripten_set_timeout(
+        onIdleRefine, self->qualityGovernor.idleIn(now) + 1.0, self);
+    return;
+  }
+  // A redraw is already on its way and will schedule the next attempt.
+  if (self->view->Camera()->WorldViewProjState().IsChanged(self->lastCameraState)) {
+    return;
+  }
+
+  // updateView() first, as its ProcessInput() would undo the refinement.
+  self->updateView();
+  self->setIdleRefined(true);
+}
+
+void StaircaseViewController::setGpuPicking(bool value) {
+  gpuPicking = value;
+  if (!value) {
+    gpuPicker.reset();
+    gpuHovered.Nullify();
+  }
+}
+
+bool StaircaseViewController::isGpuPicking() const { return gpuPicking; }
+
+FrameTimeHistory const &StaircaseViewController::getPickTimes() const {
+  return pickTimes;
+}
+
+double StaircaseViewController::firstPickTime() const { return firstPick; }
+
+void StaircaseViewController::recordPick(double ms) {
+  pickTimes.push(ms);
+  if (firstPick < 0.0) { firstPick = ms; }
+}
+
+int StaircaseViewController::gpuPick(Graphic3d_Vec2i const &pixel) const {
+  if (!gpuPicker) { return -1; }
+  // The view cube is drawn over the parts but is not in the id rendering;
+  // the square around it is left to the selector.
+  if (!viewCube.IsNull() && !viewCube->TransformPersistence().IsNull()) {
+    Graphic3d_Vec2i const offset = viewCube->TransformPersistence()->Offset2d();
+    if (pixel.x() >= windowSize.x() - 2 * offset.x() &&
+        pixel.y() >= windowSize.y() - 2 * offset.y()) {
+      return -1;
+    }
+  }
+  int const part = gpuPicker->pick(pixel);
+  return part < int(activeShapes.size()) ? part : -1;
+}
+
+void StaircaseViewController::gpuHover(Handle(AIS_InteractiveObject) const &object) {
+  if (object == gpuHovered) { return; }
+  if (!gpuHovered.IsNull()) {
+    if (aisContext->IsSelected(gpuHovered)) {
+      aisContext->HilightWithColor(
+          gpuHovered, aisContext->HighlightStyle(Prs3d_TypeOfHighlight_Selected),
+          Standard_False);
+    } else {
+      aisContext->Unhilight(gpuHovered, Standard_False);
+    }
+  }
+  gpuHovered = object;
+  if (!object.IsNull()) {
+    aisContext->ClearDetected(Standard_False);
+    aisContext->HilightWithColor(
+        object, aisContext->HighlightStyle(Prs3d_TypeOfHighlight_Dynamic),
+        Standard_False);
+  }
+  view->Invalidate();
+}
+
+void StaircaseViewController::handleDynamicHighlight(
+    Handle(AIS_InteractiveContext) const &context, Handle(V3d_View) const &view) {
+  if (!myGL.MoveTo.ToHilight) {
+    AIS_ViewController::handleDynamicHighlight(context, view);
+    return;
+  }
+
+  double const start = emscripten_get_now();
+  int const part = gpuPick(myGL.MoveTo.Point);
+  if (part >= 0) {
+    myGL.MoveTo.ToHilight = false;
+    gpuHover(activeShapes[part]);
+  } else if (!gpuHovered.IsNull()) {
+    gpuHover(Handle(AIS_InteractiveObject)());
+  }
+  // Also starts drags, which need the selector's detection.
+  AIS_ViewController::handleDynamicHighlight(context, view);
+  recordPick(emscripten_get_now() - start);
+}
+
+void StaircaseViewController::handleSelectionPick(
+    Handle(AIS_InteractiveContext) const &context, Handle(V3d_View) const &view) {
+  if (myGL.Selection.Tool != AIS_ViewSelectionTool_Picking ||
+      myGL.Selection.Points.IsEmpty()) {
+    AIS_ViewController::handleSelectionPick(context, view);
+    return;
+  }
+
+  double const start = emscripten_get_now();
+  int const part = gpuPick(myGL.Selection.Points.Last());
+  if (part >= 0) {
+    Handle(AIS_InteractiveObject) const &object = activeShapes[part];
+    if (myGL.Selection.Scheme == AIS_SelectionScheme_XOR) {
+      context->AddOrRemoveSelected(object, Standard_False);
+    } else {
+      context->SetSelected(object, Standard_False);
+    }
+    myGL.Selection.Points.Clear();
+    OnSelectionChanged(context, view);
+    view->Invalidate();
+  } else {
+    AIS_ViewController::handleSelectionPick(context, view);
+  }
+  recordPick(emscripten_get_now() - start);
+}
+
 void StaircaseViewController::fitAllObjects(bool withAuto) {
-  if (withAuto) {
+  Bnd_Box const box = partIndex.visibleBox();
+  if (!box.IsVoid()) {
+    view->FitAll(box, 0.01, false);
+  } else if (withAuto) {
     this->FitAllAuto(aisContext, view);
   } else {
     view->FitAll(0.01, false);
@@ -302,32 +1352,186 @@ void StaircaseViewController::fitAllObjects(bool withAuto) {
   this->updateView();
 }
 
+void StaircaseViewController::fitSelection() {
+  Bnd_Box box;
+  for (aisContext->InitSelected(); aisContext->MoreSelected();
+       aisContext->NextSelected()) {
+    auto const found = partOf.find(aisContext->SelectedInteractive().get());
+    if (found != partOf.end()) { box.Add(partIndex.partBox(found->second)); }
+  }
+  // Batched parts are selected through owners of the batch.
+  if (box.IsVoid()) { box = aisContext->BoundingBoxOfSelection(view); }
+  if (box.IsVoid()) { return; }
+  view->FitAll(box, 0.01, false);
+  this->updateView();
+}
+
+std::vector<size_t> StaircaseViewController::boxSelect(double x0, double y0,
+                                                       double x1, double y1) {
+  double const start = emscripten_get_now();
+  int const left = int(std::min(x0, x1) * devicePixelRatio);
+  int const right = int(std::max(x0, x1) * devicePixelRatio);
+  int const top = int(std::min(y0, y1) * devicePixelRatio);
+  int const bottom = int(std::max(y0, y1) * devicePixelRatio);
+
+  // The region is bounded by the planes through the rays of neighbouring
+  // corners; the rectangle's center on the near plane is inside all four.
+  int const xs[4] = {left, right, right, left};
+  int const ys[4] = {top, top, bottom, bottom};
+  gp_Pnt corners[4];
+  gp_Vec directions[4];
+  gp_XYZ center;
+  for (int k = 0; k < 4; ++k) {
+    double x, y, z, dx, dy, dz;
+    view->ConvertWithProj(xs[k], ys[k], x, y, z, dx, dy, dz);
+    corners[k].SetCoord(x, y, z);
+    directions[k].SetCoord(dx, dy, dz);
+    center += corners[k].XYZ() / 4.0;
+  }
+
+  std::vector<size_t> parts;
+  std::vector<gp_Pln> planes;
+  for (int k = 0; k < 4; ++k) {
+    gp_Vec const normal =
+        directions[k].Crossed(gp_Vec(corners[k], corners[(k + 1) % 4]));
+    if (normal.Magnitude() < gp::Resolution()) { break; }
+    gp_Pln plane(corners[k], gp_Dir(normal));
+    double a, b, c, d;
+    plane.Coefficients(a, b, c, d);
+    if (a * center.X() + b * center.Y() + c * center.Z() + d < 0.0) {
+      plane = gp_Pln(corners[k], -gp_Dir(normal));
+    }
+    planes.push_back(plane);
+  }
+  // A rectangle without area selects what is under its corner.
+  if (planes.size() < 4) {
+    int const part = nearestPart(x0, y0);
+    if (part >= 0) { parts.push_back(size_t(part)); }
+  } else {
+    parts = partIndex.partsInRegion(planes);
+  }
+  queryTimes.push(emscripten_get_now() - start);
+
+  aisContext->ClearSelected(Standard_False);
+  for (size_t part : parts) {
+    if (part < activeShapes.size() && !activeShapes[part].IsNull()) {
+      aisContext->AddOrRemoveSelected(activeShapes[part], Standard_False);
+    }
+  }
+  this->updateView();
+  return parts;
+}
+
+int StaircaseViewController::nearestPart(double x, double y) {
+  double const start = emscripten_get_now();
+  double px, py, pz, dx, dy, dz;
+  view->ConvertWithProj(int(x * devicePixelRatio), int(y * devicePixelRatio),
+                        px, py, pz, dx, dy, dz);
+  int const part =
+      partIndex.nearestPart(gp_Lin(gp_Pnt(px, py, pz), gp_Dir(dx, dy, dz)));
+  queryTimes.push(emscripten_get_now() - start);
+  return part;
+}
+
+std::vector<size_t> StaircaseViewController::partsInBox(Bnd_Box const &box) {
+  double const start = emscripten_get_now();
+  std::vector<size_t> parts = partIndex.partsInBox(box);
+  queryTimes.push(emscripten_get_now() - start);
+  return parts;
+}
+
+PartIndex const &StaircaseViewController::getPartIndex() const {
+  return partIndex;
+}
+
+FrameTimeHistory const &StaircaseViewController::getQueryTimes() const {
+  return queryTimes;
+}
+
 EM_BOOL
 StaircaseViewController::onMouseEvent(int eventType,
                                       EmscriptenMouseEvent const *event) {
   if (view.IsNull()) { return EM_FALSE; }
   auto aWindow = Handle(Wasm_Window)::DownCast(view->Window());
-  if (eventType == EMSCRIPTEN_EVENT_MOUSEMOVE ||
-      eventType == EMSCRIPTEN_EVENT_MOUSEUP) {
-    jsUpdateBoundingClientRect();
-    EmscriptenMouseEvent anEvent = *event;
-    anEvent.targetX -= jsGetBoundingClientLeft();
-    anEvent.targetY -= jsGetBoundingClientTop();
-    aWindow->ProcessMouseEvent(*this, eventType, &anEvent);
-    return EM_FALSE;
-  }
   return aWindow->ProcessMouseEvent(*this, eventType, event) ? EM_TRUE
                                                              : EM_FALSE;
 }
 
+void StaircaseViewController::onPointerEvent(int eventType,
+                                             EmscriptenMouseEvent const &event) {
+  if (view.IsNull()) { return; }
+  double const start = emscripten_get_now();
+
+  // Moves only keep the latest position until the next frame; presses and
+  // releases go through at once, after the moves before them. So do moves
+  // that change the buttons, as chorded presses and releases arrive as moves.
+  unsigned short const buttons = hasPendingMove ? pendingMove.buttons : lastButtons;
+  if (eventType == EMSCRIPTEN_EVENT_MOUSEMOVE && event.buttons == buttons) {
+    if (hasPendingMove) { ++coalescedEvents; }
+    notePendingInput();
+    pendingMove = event;
+    hasPendingMove = true;
+    ProcessInput();
+  } else {
+    flushInput();
+    lastButtons = event.buttons;
+    auto aWindow = Handle(Wasm_Window)::DownCast(view->Window());
+    aWindow->ProcessMouseEvent(*this, eventType, &event);
+  }
+  inputTime += emscripten_get_now() - start;
+}
+
 EM_BOOL
 StaircaseViewController::onWheelEvent(int eventType,
                                       EmscriptenWheelEvent const *event) {
   if (view.IsNull() || eventType != EMSCRIPTEN_EVENT_WHEEL) { return EM_FALSE; }
+  double const start = emscripten_get_now();
 
-  Handle(Wasm_Window) aWindow = Handle(Wasm_Window)::DownCast(view->Window());
-  return aWindow->ProcessWheelEvent(*this, eventType, event) ? EM_TRUE
-                                                             : EM_FALSE;
+  // Deltas of one frame are summed; a change of unit flushes the sum first.
+  if (hasPendingWheel && pendingWheel.deltaMode != event->deltaMode) {
+    flushInput();
+  }
+  if (hasPendingWheel) {
+    ++coalescedEvents;
+    double const deltaX = pendingWheel.deltaX + event->deltaX;
+    double const deltaY = pendingWheel.deltaY + event->deltaY;
+    double const deltaZ = pendingWheel.deltaZ + event->deltaZ;
+    pendingWheel = *event;
+    pendingWheel.deltaX = deltaX;
+    pendingWheel.deltaY = deltaY;
+    pendingWheel.deltaZ = deltaZ;
+  } else {
+    notePendingInput();
+    pendingWheel = *event;
+    hasPendingWheel = true;
+  }
+  ProcessInput();
+  inputTime += emscripten_get_now() - start;
+  return EM_TRUE;
+}
+
+void StaircaseViewController::notePendingInput() {
+  // Event time stamps have another origin than emscripten_get_now(); the
+  // latency is measured from when the handler saw the input.
+  if (!hasPendingMove && !hasPendingWheel) {
+    oldestPendingInput = emscripten_get_now();
+  }
+}
+
+void StaircaseViewController::flushInput() {
+  if (!hasPendingMove && !hasPendingWheel) { return; }
+
+  auto aWindow = Handle(Wasm_Window)::DownCast(view->Window());
+  if (hasPendingMove) {
+    hasPendingMove = false;
+    lastButtons = pendingMove.buttons;
+    aWindow->ProcessMouseEvent(*this, EMSCRIPTEN_EVENT_MOUSEMOVE, &pendingMove);
+  }
+  if (hasPendingWheel) {
+    hasPendingWheel = false;
+    aWindow->ProcessWheelEvent(*this, EMSCRIPTEN_EVENT_WHEEL, &pendingWheel);
+  }
+  flushedInputAt = oldestPendingInput;
 }
 
 EM_BOOL
@@ -501,3 +1705,39 @@ void StaircaseViewController::setAISContext(Handle(AIS_InteractiveContext)
 Graphic3d_Vec2i const &StaircaseViewController::getWindowSize() const {
   return windowSize;
 }
+
+FrameTimeHistory const &StaircaseViewController::getFrameTimes() const {
+  return frameTimes;
+}
+
+FrameTimeHistory const &StaircaseViewController::getFrameIntervals() const {
+  return frameIntervals;
+}
+
+FrameTimeHistory const &StaircaseViewController::getInputLatencies() const {
+  return inputLatencies;
+}
+
+FrameTimeHistory const &StaircaseViewController::getInputTimes() const {
+  return inputTimes;
+}
+
+size_t StaircaseViewController::coalescedEventCount() const {
+  return coalescedEvents;
+}
+
+Handle(Graphic3d_FrameStats) StaircaseViewController::getFrameStats() const {
+  if (view.IsNull()) { return Handle(Graphic3d_FrameStats)(); }
+
+  auto aDriver = Handle(OpenGl_GraphicDriver)::DownCast(view->Viewer()->Driver());
+  if (aDriver.IsNull() || aDriver->GetSharedContext().IsNull()) {
+    return Handle(Graphic3d_FrameStats)();
+  }
+  return aDriver->GetSharedContext()->FrameStats();
+}
+
+void StaircaseViewController::setShowStats(bool value) {
+  if (view.IsNull()) { return; }
+  view->ChangeRenderingParams().ToShowStats = value;
+  this->updateView();
+}
@@ -1,33 +1,207 @@
 #ifndef STAIRCASEVIEWCONTROLLER_HPP
 #define STAIRCASEVIEWCONTROLLER_HPP
+#include "AmbientOcclusion.hpp"
+#include "BatchedParts.hpp"
+#include "FeatureEdges.hpp"
+#include "GpuPicker.hpp"
+#include "HiddenLineView.hpp"
+#include "LazyScene.hpp"
+#include "ModelRegistry.hpp"
+#include "PartIndex.hpp"
+#include "QualityGovernor.hpp"
+#include "QuantizedPart.hpp"
+#include "ViewerStats.hpp"
 #include <AIS_ViewController.hxx>
+#include <atomic>
 #include <emscripten.h>
 #include <emscripten/bind.h>
 #include <emscripten/html5.h>
 #include <mutex>
+#include <unordered_map>
 #include <opencascade/AIS_Shape.hxx>
 #include <opencascade/AIS_ViewCube.hxx>
 #include <opencascade/Prs3d_TextAspect.hxx>
 #include <opencascade/TDocStd_Document.hxx>
 #include <opencascade/Aspect_VKey.hxx>
+#include <opencascade/Graphic3d_FrameStats.hxx>
 
 class StaircaseViewController : protected AIS_ViewController {
 public:
   StaircaseViewController(std::string const &canvasId)
       : canvasId(canvasId), devicePixelRatio(1), updateRequestCount(0) {}
-  virtual ~StaircaseViewController() {}
+  virtual ~StaircaseViewController();
   void initWindow();
   bool initViewer();
   void initPixelScaleRatio();
   void initScene();
   void redrawView();
   void updateView();
+  /** Fits the visible parts from the part index, else all presentations. */
   void fitAllObjects(bool withAuto);
+  /** Fits the boxes of the selected parts. */
+  void fitSelection();
+
+  /**
+   * Selects the visible parts whose boxes intersect the region under a
+   * rectangle of the canvas, replacing the selection.
+   *
+   * @return The indices of the parts, in no particular order.
+   */
+  std::vector<size_t> boxSelect(double x0, double y0, double x1, double y1);
+  /**
+   * The visible part whose box the ray through a canvas point enters
+   * first, or -1. Boxes are coarser than the selector, which tests the
+   * triangles.
+   */
+  int nearestPart(double x, double y);
+  /** Visible parts whose boxes intersect a world-space box. */
+  std::vector<size_t> partsInBox(Bnd_Box const &box);
+  PartIndex const &getPartIndex() const;
+  /** Milliseconds of the part index queries above. */
+  FrameTimeHistory const &getQueryTimes() const;
   void removeAllObjects();
-  void initStepFile(Handle(TDocStd_Document) aDoc);
+  /**
+   * Displays a model.
+   *
+   * @param model The model to show.
+   * @param prebuilt Objects of prebuildObjects() for the same model, if any.
+   */
+  void initStepFile(std::shared_ptr<LoadedModel> const &model,
+                    std::vector<Handle(AIS_InteractiveObject)> const &prebuilt = {});
+
+  /**
+   * Creates the objects initStepFile() would show for the parts of a model,
+   * with their selection and its BVHs already computed, so that neither
+   * display nor the first pick has to. Runs on the background worker and
+   * the pool, and only reads the controller's atomic settings: the objects
+   * stay detached from the AIS context until initStepFile() adds them.
+   * Returns nothing for lazy models, or when the parts would be batched or
+   * instanced.
+   */
+  std::vector<Handle(AIS_InteractiveObject)> prebuildObjects(LoadedModel &model) const;
+  void setPrebuildSelection(bool value);
+  void updateLazyScene();
+  LazyScene *getLazyScene() const;
+
+  /**
+   * In hidden line mode the parts are drawn as their visible edges for the
+   * current camera, computed on the worker pool once the camera is still.
+   * The shaded parts are shown while the camera moves and until the lines
+   * are ready. Lazy models stay shaded.
+   *
+   * @param enabled Whether to draw hidden lines.
+   * @param showHidden Whether to also draw hidden edges, dashed.
+   */
+  void setHiddenLineMode(bool enabled, bool showHidden);
+  bool isHiddenLineMode() const;
+  void updateHiddenLines();
+  HiddenLineView const *getHiddenLines() const;
+
+  /**
+   * Draws the feature edges of the parts over them: boundaries, and creases
+   * sharper than an angle. They are extracted from the triangulations on
+   * the worker pool, once per model and angle, and drawn as one line
+   * buffer per batch of parts. Lazy models have none.
+   *
+   * @param enabled Whether to draw feature edges.
+   * @param angle The smallest crease angle, in degrees.
+   */
+  void setFeatureEdges(bool enabled, double angle);
+  bool isShowingFeatureEdges() const;
+  void updateFeatureEdges();
+  size_t featureEdgeBatchCount() const;
+  size_t featureEdgeSegmentCount() const;
+  /** Milliseconds until the last feature edges were ready, -1 before. */
+  double featureEdgeTime() const;
+
+  /**
+   * Shades batched parts with ambient occlusion baked on the worker pool.
+   * Parts are shaded as they finish; the bake is cached in the model for
+   * the ray count. Parts that are not batched keep OCCT's shading.
+   *
+   * @param enabled Whether to shade with ambient occlusion.
+   * @param rays Rays per vertex.
+   */
+  void setAmbientOcclusion(bool enabled, int rays);
+  void updateAmbientOcclusion();
+  OcclusionBaker const *getOcclusionBaker() const;
+
+  /** Whether the next initStepFile() merges parts into BatchedParts. */
+  void setBatchParts(bool value);
+  void setPartVisible(size_t part, bool visible);
+  size_t batchCount() const;
+
+  /**
+   * Bulk changes of the parts shown by initStepFile(). Every change is
+   * applied first and the view is updated once at the end. Indices out of
+   * range are ignored.
+   */
+  void setPartsVisible(std::vector<uint32_t> const &parts, bool visible);
+  /** Shows the given parts and hides all others. */
+  void isolateParts(std::vector<uint32_t> const &parts);
+  void setPartsColor(std::vector<uint32_t> const &parts,
+                     Quantity_Color const &color);
+  /** Returns parts to the color they have in the file. */
+  void resetPartsColor(std::vector<uint32_t> const &parts);
+  /**
+   * @param transparency From 0 for opaque to 1. Batched parts stay opaque.
+   */
+  void setPartsTransparency(std::vector<uint32_t> const &parts,
+                            double transparency);
+
+  /**
+   * Whether the next initStepFile() shows parts that share a TShape and a
+   * color as AIS_ConnectedInteractive instances of one prototype, so that
+   * the prototype's buffers are uploaded once.
+   */
+  void setInstanceParts(bool value);
+  size_t prototypeCount() const;
+  size_t instanceCount() const;
+
+  /**
+   * Whether the next initStepFile() shows parts as QuantizedPart objects.
+   * Parts whose decoding error exceeds a tolerance keep full precision.
+   *
+   * @param value Whether to quantize.
+   * @param positionTolerance Largest position error, as a fraction of the
+   *                          model's diagonal.
+   * @param normalTolerance Largest normal error, in degrees.
+   */
+  void setQuantizeParts(bool value, double positionTolerance,
+                        double normalTolerance);
+  size_t quantizedCount() const;
+  size_t quantizedBytes() const;
+  size_t fullPrecisionBytes() const;
+
+  /**
+   * Whether parts shown by the next initStepFile() are picked from an id
+   * rendering on the GPU instead of by the selector. Batched and lazy
+   * scenes, the view cube and empty pixels still use the selector.
+   */
+  void setGpuPicking(bool value);
+  bool isGpuPicking() const;
+  /** Milliseconds of every highlight and selection pick. */
+  FrameTimeHistory const &getPickTimes() const;
+  /** Milliseconds of the first pick after initStepFile(), -1 before. */
+  double firstPickTime() const;
+
+  /**
+   * Compiles the shader programs and rasterizes the view cube's glyphs that
+   * the first frame of a model would otherwise stall on, by drawing a
+   * stand-in part, shaded the way the next model will be and as lines,
+   * together with the view cube into an offscreen image. Does nothing once
+   * a model is shown.
+   */
+  void warmUp();
+  /** Milliseconds warmUp() took, -1 if it has not run. */
+  double warmUpTime() const;
+  /** Milliseconds of the first frame after initStepFile(), -1 before. */
+  double firstModelFrameTime() const;
   char const *getCanvasTag();
   EM_BOOL onMouseEvent(int eventType, EmscriptenMouseEvent const *event);
   EM_BOOL onWheelEvent(int eventType, EmscriptenWheelEvent const *event);
+  /** Mouse and pen pointer events, with canvas-relative target coordinates. */
+  void onPointerEvent(int eventType, EmscriptenMouseEvent const &event);
   EM_BOOL onResizeEvent(int eventType, EmscriptenUiEvent const *event);
   EM_BOOL onTouchEvent(int eventType, EmscriptenTouchEvent const *event);
   EM_BOOL onFocusEvent(int eventType, EmscriptenFocusEvent const *event);
@@ -48,12 +222,54 @@ public:
   void setAISContext(Handle(AIS_InteractiveContext) const &aisContext);
 
   bool shouldRender;
-  std::vector<Handle(AIS_Shape)> activeShapes;
+  std::vector<Handle(AIS_InteractiveObject)> activeShapes;
   Graphic3d_Vec2i const &getWindowSize() const;
 
   void setCanLoadNewFile(bool value);
   bool canLoadNewFile();
   double cubeSize;
+
+  FrameTimeHistory const &getFrameTimes() const;
+  FrameTimeHistory const &getFrameIntervals() const;
+  /** Milliseconds from the oldest input of a frame until it was drawn. */
+  FrameTimeHistory const &getInputLatencies() const;
+  /** Milliseconds spent in input handlers between two frames. */
+  FrameTimeHistory const &getInputTimes() const;
+  /** Moves and wheel events merged into a previous one of the same frame. */
+  size_t coalescedEventCount() const;
+  Handle(Graphic3d_FrameStats) getFrameStats() const;
+  void setShowStats(bool value);
+
+  /**
+   * Configures the quality governor, which lowers the render resolution
+   * while the camera moves and restores it once the camera is idle.
+   *
+   * @param targetFrameTime Frame time to aim for in ms, 0 to turn it off.
+   * @param cheapShading Whether to shade per vertex while moving (default
+   *                     off).
+   * @param hideSmallParts Whether to hide parts smaller than 2% of the
+   *                       scene while moving.
+   */
+  void setAdaptiveQuality(double targetFrameTime, bool cheapShading,
+                          bool hideSmallParts);
+  QualityGovernor const &getQualityGovernor() const;
+
+  /**
+   * Once the camera is idle, redraws a single antialiased frame: with MSAA
+   * where the context supports it, else at twice the resolution. Any input
+   * returns to normal frames.
+   *
+   * @param samples MSAA samples for the idle frame, 0 to turn it off.
+   */
+  void setIdleAntialiasing(int samples);
+  bool isIdleRefined() const;
+
+protected:
+  void handleDynamicHighlight(Handle(AIS_InteractiveContext) const &context,
+                              Handle(V3d_View) const &view) override;
+  void handleSelectionPick(Handle(AIS_InteractiveContext) const &context,
+                           Handle(V3d_View) const &view) override;
+
 private:
   std::string canvasId;
   std::string prefixedCanvasId;
@@ -62,10 +278,133 @@ private:
   unsigned int updateRequestCount;
   Graphic3d_Vec2i windowSize;
 
+  FrameTimeHistory frameTimes;
+  FrameTimeHistory frameIntervals;
+  double lastFrameStart = 0.0;
+
+  EmscriptenMouseEvent pendingMove{};
+  EmscriptenWheelEvent pendingWheel{};
+  bool hasPendingMove = false;
+  bool hasPendingWheel = false;
+  // Buttons of the last mouse event passed on to the window.
+  unsigned short lastButtons = 0;
+  double oldestPendingInput = 0.0;
+  double flushedInputAt = 0.0;
+  double inputTime = 0.0;
+  size_t coalescedEvents = 0;
+  FrameTimeHistory inputLatencies;
+  FrameTimeHistory inputTimes;
+
+  void notePendingInput();
+  void flushInput();
+
+  QualityGovernor qualityGovernor;
+  bool reduceShading = false;
+  bool reduceSmallParts = false;
+  bool qualityReduced = false;
+  Graphic3d_WorldViewProjState lastCameraState;
+  // Parts small enough to hide while moving, found once per model.
+  std::vector<size_t> smallParts;
+  std::vector<Handle(AIS_InteractiveObject)> hiddenWhileMoving;
+
+  int idleSamples = 4;
+  bool idleRefined = false;
+  // Pending emscripten_set_timeout() calls, 0 if none; the destructor
+  // clears them.
+  long qualityIdleTimer = 0;
+  long refineTimer = 0;
+
+  void applyQuality();
+  static void onQualityIdle(void *controller);
+  void setIdleRefined(bool value);
+  int maxMsaaSamples() const;
+  static void onIdleRefine(void *controller);
+
   Handle(AIS_InteractiveContext) aisContext;
   Handle(Prs3d_TextAspect) textAspect;
   Handle(AIS_ViewCube) viewCube;
   Handle(V3d_View) view;
+  std::unique_ptr<LazyScene> lazyScene;
+  PartIndex partIndex;
+  std::unordered_map<AIS_InteractiveObject const *, size_t> partOf;
+  FrameTimeHistory queryTimes;
+  Handle(BatchedParts) batchedParts;
+  // Read by prebuildObjects() on the background worker.
+  std::atomic<bool> batchParts{false};
+  std::atomic<bool> instanceParts{false};
+  std::atomic<bool> prebuildSelection{true};
+  size_t prototypes = 0;
+  size_t instances = 0;
+  std::atomic<bool> quantizeParts{false};
+  std::atomic<double> quantizePositionTolerance{1e-5};
+  std::atomic<double> quantizeNormalTolerance{2.0};
+  size_t quantized = 0;
+  size_t quantizedGpuBytes = 0;
+  size_t quantizedFullBytes = 0;
+
+  void displayInstanced(std::vector<ModelPart> const &parts);
+  std::shared_ptr<LoadedModel> displayedModel;
+  // The parts batchedParts was built from, with their current colors.
+  std::vector<ModelPart> batchedSource;
+
+  size_t partCount() const;
+  void applyVisibility(std::vector<size_t> const &parts, bool visible);
+  void applyPartColor(uint32_t part, std::optional<Quantity_Color> const &color);
+  Handle(AIS_InteractiveObject) const &ownObject(size_t part);
+  void rebuildBatches();
+  Handle(AIS_InteractiveObject) createPartObject(ModelPart const &part,
+                                                 double size) const;
+
+  bool hiddenLineMode = false;
+  bool showHiddenLines = false;
+  std::unique_ptr<HiddenLineView> hiddenLines;
+  // Erased while the hidden lines are shown.
+  std::vector<Handle(AIS_InteractiveObject)> erasedForLines;
+  bool linesShown = false;
+
+  void startHiddenLines();
+  std::vector<TopoDS_Shape> visiblePartShapes() const;
+  void hideShadedParts();
+  void showShadedParts();
+
+  // Written by the pool, drained by updateFeatureEdges().
+  struct EdgeInbox {
+    std::mutex mutex;
+    std::shared_ptr<LoadedModel> model;
+    double angle = 0.0;
+    std::shared_ptr<PartEdges const> edges;
+    double milliseconds = 0.0;
+  };
+
+  bool featureEdges = false;
+  double featureEdgeAngle = 30.0;
+  std::shared_ptr<EdgeInbox> edgeInbox = std::make_shared<EdgeInbox>();
+  std::vector<Handle(FeatureEdgeBatch)> edgeBatches;
+  double edgeTime = -1.0;
+
+  void requestFeatureEdges();
+  void clearFeatureEdges();
+  void applyEdgeVisibility(std::vector<size_t> const &parts, bool visible);
+
+  bool ambientOcclusion = false;
+  int occlusionRays = 16;
+  std::unique_ptr<OcclusionBaker> occlusionBaker;
+
+  void startOcclusion();
+  void applyOcclusion(std::vector<size_t> const &parts);
+
+  bool gpuPicking = false;
+  std::unique_ptr<GpuPicker> gpuPicker;
+  Handle(AIS_InteractiveObject) gpuHovered;
+  FrameTimeHistory pickTimes;
+  double firstPick = -1.0;
+  double warmUpMs = -1.0;
+  bool firstModelFramePending = false;
+  double firstModelFrame = -1.0;
+
+  int gpuPick(Graphic3d_Vec2i const &pixel) const;
+  void gpuHover(Handle(AIS_InteractiveObject) const &object);
+  void recordPick(double ms);
 
   std::mutex fileLoadMutex;
   bool _canLoadNewFile;
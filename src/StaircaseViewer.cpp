@@ -1,11 +1,17 @@
 #include "StaircaseViewer.hpp"
 #include "GraphicsUtilities.hpp"
+#include "LoadArena.hpp"
+#include "MeshOptimizer.hpp"
 #include "OCCTUtilities.hpp"
+#include "ProductIndex.hpp"
+#include "StepPrescan.hpp"
 #include <atomic>
 #include <emscripten/threading.h>
+#include <emscripten/val.h>
 #include <memory>
 #include <opencascade/Standard_Version.hxx>
 #include <optional>
+#include <unordered_map>
 
 #ifndef DIST_BUILD
 #include "EmbeddedStepFile.hpp"
@@ -18,6 +24,10 @@ std::queue<Staircase::Message> StaircaseViewer::backgroundQueue;
 std::mutex StaircaseViewer::backgroundQueueMutex;
 std::condition_variable StaircaseViewer::cv;
 bool StaircaseViewer::mainLoopSet = false;
+std::atomic<unsigned int> StaircaseViewer::transferPartitions = 0;
+std::atomic<bool> StaircaseViewer::lazyLoading = false;
+std::atomic<int> StaircaseViewer::preferredWebGLVersion = 2;
+std::atomic<bool> StaircaseViewer::shaderWarmUp = true;
 
 // clang-format off
 EM_JS(const char*, generate_uuid_js, (), {
@@ -65,10 +75,16 @@ StaircaseViewer::StaircaseViewer(std::string const &containerId) {
     return;
   }
   context->viewController->initWindow();
-  context->webGLContext = setupWebGLContext(context->canvasId);
+  context->webGLContext =
+      setupWebGLContext(context->canvasId, preferredWebGLVersion);
+  debugOut("WebGL version: ", webGLVersion(context->webGLContext));
+  context->parallelShaderCompile =
+      enableParallelShaderCompile(context->webGLContext);
   context->viewController->initViewer();
-
+  // Once construction has returned, and before a model can be shown.
+  if (shaderWarmUp) { context->pushMessage(MessageType::WarmUp); }
   context->pushMessage(MessageType::NextFrame); // kick off event loop
+  context->frameLoopScheduled = true;
   emscripten_async_run_in_main_runtime_thread(EM_FUNC_SIG_VI, handleMessages,
                                               context.get());
 
@@ -150,6 +166,22 @@ StaircaseViewer::loadStepFile(std::string const &stepFileContent) {
 
   return 0;
 }
+
+EMSCRIPTEN_KEEPALIVE int
+StaircaseViewer::loadGeneratedScene(unsigned int partCount) {
+  if (!context->canLoadNewFile() || context->setCanLoadNewFile(false) != 0) {
+    std::cout << "Cannot load a scene at this moment." << std::endl;
+    return 1;
+  }
+  generatedPartCount = partCount;
+
+  Staircase::Message message(MessageType::LoadGeneratedScene, this);
+  StaircaseViewer::pushBackground(message);
+  StaircaseViewer::ensureBackgroundWorker();
+
+  return 0;
+}
+
 void StaircaseViewer::setStepFileContent(std::string const &content) {
   std::lock_guard<std::mutex> lock(stepFileContentMutex);
   _stepFileContent = content;
@@ -230,17 +262,51 @@ void *StaircaseViewer::_loadStepFile(void *arg) {
   auto viewer = static_cast<StaircaseViewer *>(arg);
   auto context = viewer->context;
   debugOut("StaircaseViewer::_loadStepFile(): containerId='", context->containerId, "'");
+  TRACE_SCOPE("loadStepFile");
+
+  std::string stepFileContent = viewer->getStepFileContent();
+  bool const lazy = lazyLoading;
+  ModelKey const key = ModelRegistry::contentKey(stepFileContent, lazy);
+
+  // Attach to a model another viewer parsed and meshed, waiting for it if
+  // that viewer is still loading it. Otherwise this load holds the claim
+  // until the model is inserted or the load fails.
+  ModelClaim claim;
+  if (auto model = ModelRegistry::findOrClaim(key, claim)) {
+    debugOut("Attaching to shared model: key=", key.hash);
+    context->stats.beginLoad(true);
+    ModelUse use(model);
+    ensureMeshed(*model);
+    auto objects = context->viewController->prebuildObjects(*model);
+    context->setPendingModel(std::move(use), std::move(objects));
+    context->pushMessage(*chain(MessageType::InitStepFile,
+                                MessageType::NextFrame));
+    return nullptr;
+  }
+
+  context->stats.beginLoad(false);
+
+  StepPrescan prescan = prescanStepData(stepFileContent);
+  if (!prescan.hasDataSection) {
+    std::cerr << "Not a STEP file: no DATA section found." << std::endl;
+    context->stats.endLoad();
+    context->setCanLoadNewFile(true);
+    return nullptr;
+  }
+  context->stats.setEntityCount(prescan.entityCount);
+  debugOut("STEP DATA section entities: ", prescan.entityCount);
 
   context->showingSpinner = true;
   context->pushMessage({MessageType::DrawLoadingScreen});
 
   // Read STEP file and handle the result in the callback
-  readStepFile(XCAFApp_Application::GetApplication(),
-               viewer->getStepFileContent(),
-               [&context](std::optional<Handle(TDocStd_Document)> docOpt) {
+  readStepFile(XCAFApp_Application::GetApplication(), stepFileContent,
+               [&context, &claim, key,
+                lazy](std::optional<Handle(TDocStd_Document)> docOpt) {
                  if (!docOpt.has_value()) {
                    std::cerr << "Failed to read STEP file: DocHandle is empty"
                              << std::endl;
+                   context->stats.endLoad();
                    context->showingSpinner = false;
                    context->pushMessage(*chain(
                        MessageType::ClearScreen, MessageType::ClearScreen,
@@ -248,34 +314,576 @@ void *StaircaseViewer::_loadStepFile(void *arg) {
                        MessageType::NextFrame));
                    return;
                  }
-                 auto aDoc = docOpt.value();
+                 ModelUse use(ModelRegistry::insert(
+                     lazy ? buildLazyModel(key, docOpt.value(), &context->stats)
+                          : buildModel(key, docOpt.value(), &context->stats),
+                     claim));
+                 auto objects =
+                     context->viewController->prebuildObjects(*use.get());
                  std::cout << "STEP File Loaded!" << std::endl;
                  context->showingSpinner = false;
-                 context->currentlyViewingDoc = aDoc;
+                 context->setPendingModel(std::move(use), std::move(objects));
 
                  context->pushMessage(
                      *chain(MessageType::ClearScreen, MessageType::ClearScreen,
                             MessageType::ClearScreen, MessageType::InitStepFile,
                             MessageType::NextFrame));
-               });
+               },
+               &context->stats, transferPartitions);
 
   return nullptr;
 }
 
+void *StaircaseViewer::_loadGeneratedScene(void *arg) {
+  auto viewer = static_cast<StaircaseViewer *>(arg);
+  auto context = viewer->context;
+  TRACE_SCOPE("loadGeneratedScene");
+
+  context->stats.beginLoad(false);
+  Handle(TDocStd_Document) doc;
+  {
+    PhaseTimer timer(&context->stats, LoadPhase::Transfer);
+    doc = generateTestDocument(XCAFApp_Application::GetApplication(),
+                               viewer->generatedPartCount);
+  }
+
+  // Not registered: there is no file content to key it by.
+  ModelUse use(buildModel(ModelKey(), doc, &context->stats));
+  auto objects = context->viewController->prebuildObjects(*use.get());
+  context->setPendingModel(std::move(use), std::move(objects));
+  context->pushMessage(*chain(MessageType::InitStepFile, MessageType::NextFrame));
+  return nullptr;
+}
+
+void *StaircaseViewer::_remeshModel(void *arg) {
+  auto viewer = static_cast<StaircaseViewer *>(arg);
+  auto context = viewer->context;
+  TRACE_SCOPE("remeshModel");
+
+  auto model = context->takeRemeshRequest();
+  if (!model) { return nullptr; }
+  ModelUse use(model);
+  ensureMeshed(*model);
+  auto objects = context->viewController->prebuildObjects(*model);
+  context->setPendingModel(std::move(use), std::move(objects));
+  context->pushMessage(*chain(MessageType::InitStepFile, MessageType::NextFrame));
+  return nullptr;
+}
+
+void StaircaseViewer::suspend() {
+  if (context->lifecycle != LifecycleState::Active) { return; }
+  context->lifecycle = LifecycleState::Suspended;
+  // Also stops redraws; the frame loop ends at its next NextFrame.
+  context->viewController->shouldRender = false;
+}
+
+void StaircaseViewer::evict() {
+  if (context->lifecycle == LifecycleState::Evicted) { return; }
+  suspend();
+  context->lifecycle = LifecycleState::Evicted;
+
+  auto view = context->getView();
+  if (!view.IsNull()) {
+    context->evictedCamera = new Graphic3d_Camera(view->Camera());
+  }
+  context->viewController->removeAllObjects();
+  // The meshes are dropped on the pool once no other viewer uses the model.
+  context->shownModel = ModelUse();
+}
+
+void StaircaseViewer::resume() {
+  LifecycleState const previous = context->lifecycle;
+  if (previous == LifecycleState::Active) { return; }
+  context->lifecycle = LifecycleState::Active;
+  context->viewController->shouldRender = true;
+
+  // Also shows a model whose load finished while the viewer was evicted.
+  auto const &model = context->currentModel;
+  if (model && context->shownModel.get() != model) {
+    // Lazy models mesh their branches again as they come into view.
+    if (model->key.lazy) {
+      context->setPendingModel(ModelUse(model));
+      context->pushMessage(MessageType::InitStepFile);
+    } else {
+      context->requestRemesh(model);
+      StaircaseViewer::pushBackground(
+          Staircase::Message(MessageType::RemeshModel, this));
+      StaircaseViewer::ensureBackgroundWorker();
+    }
+  }
+
+  context->pushMessage(MessageType::NextFrame);
+  if (!context->frameLoopScheduled) {
+    context->frameLoopScheduled = true;
+    emscripten_set_timeout(handleMessages, 0, context.get());
+  }
+  context->viewController->updateView();
+}
+
+std::string StaircaseViewer::getLifecycleState() {
+  switch (context->lifecycle) {
+  case LifecycleState::Active: return "active";
+  case LifecycleState::Suspended: return "suspended";
+  case LifecycleState::Evicted: return "evicted";
+  }
+  return "";
+}
+
 void StaircaseViewer::fitAllObjects() {
   context->viewController->fitAllObjects(true);
 }
 
+void StaircaseViewer::fitSelection() {
+  context->viewController->fitSelection();
+}
+
+template <typename T>
+static emscripten::val toTypedArray(char const *type,
+                                    std::vector<T> const &values) {
+  // The constructor copies the view out of the wasm heap.
+  return emscripten::val::global(type).new_(
+      emscripten::typed_memory_view(values.size(), values.data()));
+}
+
+static emscripten::val toUint32Array(std::vector<size_t> const &values) {
+  return toTypedArray("Uint32Array",
+                      std::vector<uint32_t>(values.begin(), values.end()));
+}
+
+emscripten::val StaircaseViewer::boxSelect(double x0, double y0, double x1,
+                                           double y1) {
+  return toUint32Array(context->viewController->boxSelect(x0, y0, x1, y1));
+}
+
+int StaircaseViewer::nearestPart(double x, double y) {
+  return context->viewController->nearestPart(x, y);
+}
+
+emscripten::val StaircaseViewer::partsInBox(double xmin, double ymin,
+                                            double zmin, double xmax,
+                                            double ymax, double zmax) {
+  Bnd_Box box;
+  box.Update(xmin, ymin, zmin, xmax, ymax, zmax);
+  return toUint32Array(context->viewController->partsInBox(box));
+}
+
+emscripten::val StaircaseViewer::getProductChildren(unsigned int node,
+                                                   unsigned int offset,
+                                                   unsigned int count) {
+  using emscripten::val;
+  double const start = emscripten_get_now();
+  val page = val::object();
+  ProductIndex const *index =
+      context->currentModel ? &context->currentModel->attached<ProductIndex>()
+                            : nullptr;
+  if (!index || node >= index->size()) {
+    page.set("total", 0);
+    return page;
+  }
+
+  uint32_t const total = index->childCount(node);
+  uint32_t const first = std::min(offset, total);
+  uint32_t const size = std::min(count, total - first);
+  std::vector<uint32_t> ids(size), childCounts(size), instanceCounts(size),
+      nameIndices(size);
+  std::vector<int32_t> parts(size);
+  std::vector<float> boxes(6 * size);
+  val names = val::array();
+  std::unordered_map<uint32_t, uint32_t> pageNames;
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t const child = index->firstChild(node) + first + i;
+    ids[i] = child;
+    childCounts[i] = index->childCount(child);
+    instanceCounts[i] = index->instanceCount(child);
+    parts[i] = index->part(child);
+    std::copy(index->box(child).begin(), index->box(child).end(),
+              boxes.begin() + 6 * i);
+    auto const [it, added] =
+        pageNames.emplace(index->nameIndex(child), uint32_t(pageNames.size()));
+    if (added) { names.call<void>("push", index->name(child)); }
+    nameIndices[i] = it->second;
+  }
+
+  page.set("total", total);
+  page.set("ids", toTypedArray("Uint32Array", ids));
+  page.set("childCounts", toTypedArray("Uint32Array", childCounts));
+  page.set("instanceCounts", toTypedArray("Uint32Array", instanceCounts));
+  page.set("parts", toTypedArray("Int32Array", parts));
+  page.set("boxes", toTypedArray("Float32Array", boxes));
+  page.set("nameIndices", toTypedArray("Uint32Array", nameIndices));
+  page.set("names", names);
+  context->productQueryTimes.push(emscripten_get_now() - start);
+  return page;
+}
+
+unsigned int StaircaseViewer::getProductNodeCount() {
+  if (!context->currentModel) { return 0; }
+  return static_cast<unsigned int>(
+      context->currentModel->attached<ProductIndex>().size());
+}
+
 void StaircaseViewer::removeAllObjects() {
   context->viewController->removeAllObjects();
 }
 
+emscripten::val StaircaseViewer::getStats() {
+  using emscripten::val;
+  auto const &controller = *context->viewController;
+
+  auto const &frameTimes = controller.getFrameTimes();
+  val frame = val::object();
+  frame.set("samples", frameTimes.size());
+  frame.set("p50", frameTimes.percentile(50));
+  frame.set("p90", frameTimes.percentile(90));
+  frame.set("p99", frameTimes.percentile(99));
+  frame.set("max", frameTimes.max());
+  frame.set("intervalP50", controller.getFrameIntervals().percentile(50));
+  frame.set("intervalP90", controller.getFrameIntervals().percentile(90));
+  frame.set("inputLatencyP50", controller.getInputLatencies().percentile(50));
+  frame.set("inputLatencyP90", controller.getInputLatencies().percentile(90));
+  frame.set("inputTimeP50", controller.getInputTimes().percentile(50));
+  frame.set("inputTimeP90", controller.getInputTimes().percentile(90));
+  frame.set("coalescedEvents", controller.coalescedEventCount());
+
+  val render = val::object();
+  Handle(Graphic3d_FrameStats) frameStats = controller.getFrameStats();
+  if (!frameStats.IsNull()) {
+    Graphic3d_FrameStatsData const &data = frameStats->LastDataFrame();
+    // clang-format off
+    render.set("fps",               data.FrameRate());
+    render.set("fpsCpu",            data.FrameRateCpu());
+    render.set("structures",        data[Graphic3d_FrameStatsCounter_NbStructs]);
+    render.set("structuresDrawn",   data[Graphic3d_FrameStatsCounter_NbStructsNotCulled]);
+    render.set("groupsDrawn",       data[Graphic3d_FrameStatsCounter_NbGroupsNotCulled]);
+    render.set("drawCalls",         data[Graphic3d_FrameStatsCounter_NbElemsNotCulled]);
+    render.set("trianglesDrawn",    data[Graphic3d_FrameStatsCounter_NbTrianglesNotCulled]);
+    render.set("geometryBytes",     data[Graphic3d_FrameStatsCounter_EstimatedBytesGeom]);
+    // clang-format on
+  }
+  render.set("batches", controller.batchCount());
+  render.set("prototypes", controller.prototypeCount());
+  render.set("instances", controller.instanceCount());
+  render.set("resolutionScale", controller.getQualityGovernor().scale());
+  render.set("reducedQuality", controller.getQualityGovernor().isReduced());
+  render.set("idleRefined", controller.isIdleRefined());
+  render.set("quantizedParts", controller.quantizedCount());
+  render.set("quantizedBytes", controller.quantizedBytes());
+  render.set("quantizedBytesSaved",
+             controller.fullPrecisionBytes() - controller.quantizedBytes());
+  render.set("webGLVersion", webGLVersion(context->webGLContext));
+
+  val pick = val::object();
+  pick.set("gpu", controller.isGpuPicking());
+  pick.set("samples", controller.getPickTimes().size());
+  pick.set("first", controller.firstPickTime());
+  pick.set("p50", controller.getPickTimes().percentile(50));
+  pick.set("p90", controller.getPickTimes().percentile(90));
+  pick.set("max", controller.getPickTimes().max());
+
+  val hlr = val::object();
+  hlr.set("enabled", controller.isHiddenLineMode());
+  if (HiddenLineView const *hiddenLines = controller.getHiddenLines()) {
+    hlr.set("showing", hiddenLines->isShowing());
+    hlr.set("segments", static_cast<double>(hiddenLines->segmentCount()));
+    hlr.set("computed", hiddenLines->getComputeTimes().size());
+    hlr.set("computeP50", hiddenLines->getComputeTimes().percentile(50));
+    hlr.set("computeMax", hiddenLines->getComputeTimes().max());
+  }
+
+  val edges = val::object();
+  edges.set("enabled", controller.isShowingFeatureEdges());
+  edges.set("batches", controller.featureEdgeBatchCount());
+  edges.set("segments", static_cast<double>(controller.featureEdgeSegmentCount()));
+  edges.set("extractMs", controller.featureEdgeTime());
+
+  val warmUp = val::object();
+  warmUp.set("ms", controller.warmUpTime());
+  warmUp.set("parallelCompile", context->parallelShaderCompile);
+
+  val ao = val::object();
+  ao.set("enabled", controller.getOcclusionBaker() != nullptr);
+  if (OcclusionBaker const *baker = controller.getOcclusionBaker()) {
+    ao.set("rays", baker->rayCount());
+    ao.set("parts", baker->partCount());
+    ao.set("baked", baker->bakedCount());
+    ao.set("bakeMs", baker->bakeTime());
+  }
+
+  val index = val::object();
+  index.set("parts", controller.getPartIndex().size());
+  index.set("nodes", controller.getPartIndex().nodeCount());
+  index.set("queryP50", controller.getQueryTimes().percentile(50));
+  index.set("queryP90", controller.getQueryTimes().percentile(90));
+  index.set("queryMax", controller.getQueryTimes().max());
+
+  val product = val::object();
+  if (context->currentModel) {
+    ProductIndex const &productIndex =
+        context->currentModel->attached<ProductIndex>();
+    product.set("nodes", productIndex.size());
+    product.set("names", productIndex.nameCount());
+    product.set("bytes", static_cast<double>(productIndex.byteSize()));
+  }
+  product.set("pageP50", context->productQueryTimes.percentile(50));
+  product.set("pageP90", context->productQueryTimes.percentile(90));
+  product.set("pageMax", context->productQueryTimes.max());
+
+  val queues = val::object();
+  queues.set("messages", context->messageQueueSize());
+  queues.set("background", StaircaseViewer::backgroundQueueSize());
+
+  val load = val::object();
+  val loadMemory = val::object();
+  auto phases = context->stats.phaseTimings();
+  auto phaseMemory = context->stats.phaseMemory();
+  double total = 0.0;
+  for (int i = 0; i < LoadPhase::Count; ++i) {
+    char const *phaseName = LoadPhase::toString(LoadPhase::Type(i));
+    load.set(phaseName, phases[i]);
+    total += phases[i];
+
+    PhaseMemory const &mem = phaseMemory[i];
+    val phaseStats = val::object();
+    // clang-format off
+    phaseStats.set("peakFootprint",  mem.peakFootprint);
+    phaseStats.set("heapSize",       mem.heapSize);
+    phaseStats.set("inUseDelta",     static_cast<double>(mem.inUseDelta));
+    phaseStats.set("allocations",    static_cast<double>(mem.allocations));
+    phaseStats.set("allocatedBytes", static_cast<double>(mem.allocatedBytes));
+    // clang-format on
+    loadMemory.set(phaseName, phaseStats);
+  }
+  load.set("total", total);
+  load.set("sharedModel", context->stats.loadedSharedModel());
+  load.set("loading", context->stats.isLoading());
+  load.set("entities", context->stats.entityCount());
+  load.set("transferProgress", context->stats.transferProgress());
+  load.set("transferPartitions", context->stats.transferPartitions());
+  load.set("arenaChunksPinned",
+           static_cast<double>(context->stats.arenaChunksPinned()));
+  load.set("timeToInteractive", context->stats.timeToInteractive());
+  load.set("firstFrame", controller.firstModelFrameTime());
+  if (auto lazyScene = controller.getLazyScene()) {
+    emscripten::val lazy = emscripten::val::object();
+    lazy.set("branches", lazyScene->branchCount());
+    lazy.set("loaded",   lazyScene->loadedCount());
+    lazy.set("meshing",  lazyScene->pendingCount());
+    lazy.set("visibleFinal", lazyScene->getScheduler().finalFraction());
+    lazy.set("timeTo90PercentVisible",
+             lazyScene->getScheduler().timeToNinetyPercent());
+    load.set("lazy", lazy);
+  }
+  {
+    // Simulated for a FIFO post-transform cache; module-wide totals.
+    emscripten::val vertexCache = emscripten::val::object();
+    vertexCache.set("triangulations", MeshOptimizer::optimizedCount());
+    vertexCache.set("triangles", MeshOptimizer::triangleCount());
+    vertexCache.set("invocationsBefore", MeshOptimizer::invocationsBefore());
+    vertexCache.set("invocationsAfter", MeshOptimizer::invocationsAfter());
+    load.set("vertexCache", vertexCache);
+  }
+  load.set("completed", context->stats.completedLoads());
+
+  load.set("memory", loadMemory);
+
+  HeapSnapshot const heap = MemoryProfiler::snapshot();
+  val memory = val::object();
+  memory.set("heapSize", heap.heapSize);
+  memory.set("peakFootprint", heap.peakFootprint);
+  memory.set("inUse", heap.inUse);
+  memory.set("countingAllocations", MemoryProfiler::isCountingAllocations());
+  memory.set("allocations", static_cast<double>(heap.allocations));
+  memory.set("allocatedBytes", static_cast<double>(heap.allocatedBytes));
+  memory.set("footprint", heap.footprint);
+  memory.set("freeBytes", heap.freeBytes);
+  memory.set("fragmentation",
+             heap.footprint ? double(heap.freeBytes) / heap.footprint : 0.0);
+
+  LoadArena::Stats const arenaStats = LoadArena::stats();
+  val arena = val::object();
+  // clang-format off
+  arena.set("available",       LoadArena::isAvailable());
+  arena.set("enabled",         LoadArena::isEnabled());
+  arena.set("chunksAllocated", static_cast<double>(arenaStats.chunksAllocated));
+  arena.set("chunksReleased",  static_cast<double>(arenaStats.chunksReleased));
+  arena.set("blocksAllocated", static_cast<double>(arenaStats.blocksAllocated));
+  arena.set("bytesAllocated",  static_cast<double>(arenaStats.bytesAllocated));
+  arena.set("liveChunks",      static_cast<double>(arenaStats.chunksAllocated -
+                                                   arenaStats.chunksReleased));
+  arena.set("chunkSize",       static_cast<double>(LoadArena::chunkSize()));
+  // clang-format on
+  memory.set("arena", arena);
+
+  val lifecycle = val::object();
+  lifecycle.set("state", getLifecycleState());
+  lifecycle.set("loopTicks", static_cast<double>(context->loopTicks));
+  lifecycle.set("loopTime", context->loopTime);
+
+  val stats = val::object();
+  stats.set("frame", frame);
+  stats.set("render", render);
+  stats.set("pick", pick);
+  stats.set("hlr", hlr);
+  stats.set("edges", edges);
+  stats.set("ao", ao);
+  stats.set("warmUp", warmUp);
+  stats.set("index", index);
+  stats.set("product", product);
+  stats.set("queues", queues);
+  stats.set("load", load);
+  stats.set("memory", memory);
+  stats.set("lifecycle", lifecycle);
+  return stats;
+}
+
+void StaircaseViewer::setStatsOverlay(bool enabled) {
+  context->viewController->setShowStats(enabled);
+}
+
+void StaircaseViewer::setTracing(bool enabled) { Trace::setEnabled(enabled); }
+
+std::string StaircaseViewer::getTraceJSON() { return Trace::toChromeJSON(); }
+
+void StaircaseViewer::clearTrace() { Trace::clear(); }
+
+void StaircaseViewer::setLoadArena(bool enabled) {
+  LoadArena::setEnabled(enabled);
+}
+
+void StaircaseViewer::setTransferPartitions(unsigned int partitions) {
+  transferPartitions = partitions;
+}
+
+void StaircaseViewer::setLazyLoading(bool enabled) { lazyLoading = enabled; }
+
+void StaircaseViewer::setMeshOptimizationThreshold(unsigned int triangles) {
+  MeshOptimizer::setMinPartTriangles(triangles);
+}
+
+void StaircaseViewer::expandBranch(unsigned int branch) {
+  if (auto lazyScene = context->viewController->getLazyScene()) {
+    lazyScene->expand(branch);
+  }
+}
+
+void StaircaseViewer::collapseBranch(unsigned int branch) {
+  if (auto lazyScene = context->viewController->getLazyScene()) {
+    lazyScene->collapse(branch);
+  }
+}
+
+void StaircaseViewer::setBatching(bool enabled) {
+  context->viewController->setBatchParts(enabled);
+}
+
+void StaircaseViewer::setPartVisible(unsigned int part, bool visible) {
+  context->viewController->setPartVisible(part, visible);
+}
+
+// Typed arrays are copied in one go, without marshalling every element.
+static std::vector<uint32_t> toPartIndices(emscripten::val const &parts) {
+  return emscripten::convertJSArrayToNumberVector<uint32_t>(parts);
+}
+
+void StaircaseViewer::setPartsVisible(emscripten::val const &parts,
+                                      bool visible) {
+  context->viewController->setPartsVisible(toPartIndices(parts), visible);
+}
+
+void StaircaseViewer::isolateParts(emscripten::val const &parts) {
+  context->viewController->isolateParts(toPartIndices(parts));
+}
+
+void StaircaseViewer::setPartsColor(emscripten::val const &parts, double red,
+                                    double green, double blue) {
+  context->viewController->setPartsColor(
+      toPartIndices(parts), Quantity_Color(red, green, blue, Quantity_TOC_sRGB));
+}
+
+void StaircaseViewer::resetPartsColor(emscripten::val const &parts) {
+  context->viewController->resetPartsColor(toPartIndices(parts));
+}
+
+void StaircaseViewer::setPartsTransparency(emscripten::val const &parts,
+                                           double transparency) {
+  context->viewController->setPartsTransparency(toPartIndices(parts),
+                                                transparency);
+}
+
+void StaircaseViewer::setPreferredWebGLVersion(int majorVersion) {
+  preferredWebGLVersion = majorVersion;
+}
+
+void StaircaseViewer::setShaderWarmUp(bool enabled) { shaderWarmUp = enabled; }
+
+void StaircaseViewer::setInstancing(bool enabled) {
+  context->viewController->setInstanceParts(enabled);
+}
+
+void StaircaseViewer::setQuantization(bool enabled, double positionTolerance,
+                                      double normalTolerance) {
+  context->viewController->setQuantizeParts(enabled, positionTolerance,
+                                            normalTolerance);
+}
+
+void StaircaseViewer::setAdaptiveQuality(double targetFrameTime,
+                                         bool cheapShading, bool hideSmallParts) {
+  context->viewController->setAdaptiveQuality(targetFrameTime, cheapShading,
+                                              hideSmallParts);
+}
+
+void StaircaseViewer::setIdleAntialiasing(int samples) {
+  context->viewController->setIdleAntialiasing(samples);
+}
+
+void StaircaseViewer::setSelectionPrebuild(bool enabled) {
+  context->viewController->setPrebuildSelection(enabled);
+}
+
+void StaircaseViewer::setGpuPicking(bool enabled) {
+  context->viewController->setGpuPicking(enabled);
+}
+
+void StaircaseViewer::setHiddenLineMode(bool enabled, bool showHidden) {
+  context->viewController->setHiddenLineMode(enabled, showHidden);
+}
+
+void StaircaseViewer::setFeatureEdges(bool enabled, double angle) {
+  context->viewController->setFeatureEdges(enabled, angle);
+}
+
+void StaircaseViewer::setAmbientOcclusion(bool enabled, int rays) {
+  context->viewController->setAmbientOcclusion(enabled, rays);
+}
+
+void StaircaseViewer::setLazyMemoryBudget(double bytes) {
+  if (auto lazyScene = context->viewController->getLazyScene()) {
+    lazyScene->setMemoryBudget(static_cast<size_t>(bytes));
+  }
+}
+
 std::atomic<bool> isHandlingMessages{false};
 
 void *StaircaseViewer::backgroundWorker(void *) {
+  Trace::setThreadName("background worker");
   while (true) {
     Staircase::Message msg = StaircaseViewer::popBackground();
-    StaircaseViewer::_loadStepFile(msg.data);
+    // Failures rethrown by WorkerPool::parallelFor() end this message, not
+    // the worker.
+    try {
+      if (msg.type == MessageType::LoadGeneratedScene) {
+        StaircaseViewer::_loadGeneratedScene(msg.data);
+      } else if (msg.type == MessageType::RemeshModel) {
+        StaircaseViewer::_remeshModel(msg.data);
+      } else {
+        StaircaseViewer::_loadStepFile(msg.data);
+      }
+    } catch (...) {
+      std::cerr << "Background job failed." << std::endl;
+      if (msg.type != MessageType::RemeshModel) {
+        static_cast<StaircaseViewer *>(msg.data)->context->setCanLoadNewFile(true);
+      }
+    }
   }
   return nullptr;
 }
@@ -295,6 +903,11 @@ void StaircaseViewer::pushBackground(Staircase::Message const &msg) {
   cv.notify_one();
 }
 
+size_t StaircaseViewer::backgroundQueueSize() {
+  std::unique_lock<std::mutex> lock(backgroundQueueMutex);
+  return backgroundQueue.size();
+}
+
 Staircase::Message StaircaseViewer::popBackground() {
   std::unique_lock<std::mutex> lock(backgroundQueueMutex);
   cv.wait(lock, []{ return !backgroundQueue.empty(); });
@@ -310,6 +923,8 @@ void StaircaseViewer::handleMessages(void *arg) {
 
   auto context = static_cast<ViewerContext *>(arg);
   auto localQueue = context->drainMessageQueue();
+  TRACE_SCOPE("handleMessages");
+  double const loopStart = emscripten_get_now();
   bool nextFrame = false;
   int const FPS60 = 1000 / 60;
 
@@ -330,10 +945,45 @@ void StaircaseViewer::handleMessages(void *arg) {
       context->viewController->initScene();
       context->viewController->updateView();
       break;
-    case MessageType::InitStepFile:
-      context->viewController->initStepFile(context->currentlyViewingDoc);
+    case MessageType::InitStepFile: {
+      ModelUse use = context->takePendingModel();
+      auto objects = context->takePendingObjects();
+      if (!use) { break; }
+      auto const model = use.get();
+      bool const restored = model == context->currentModel;
+      context->currentModel = model;
+      // Dropped while evicted; resume() brings the model back.
+      if (context->lifecycle == LifecycleState::Evicted) { break; }
+
+      {
+        PhaseTimer timer(&context->stats, LoadPhase::Display);
+        context->viewController->initStepFile(model, objects);
+        context->shownModel = std::move(use);
+      }
+      auto view = context->getView();
+      if (restored && !view.IsNull() && !context->evictedCamera.IsNull()) {
+        view->Camera()->Copy(context->evictedCamera);
+        context->viewController->updateView();
+      }
+      context->evictedCamera.Nullify();
+      if (context->stats.isLoading()) {
+        context->stats.markInteractive();
+        context->stats.endLoad();
+      }
+      break;
+    }
+    case MessageType::WarmUp:
+      // Skipped for a viewer suspended right away; its canvas is not drawn.
+      if (context->lifecycle == LifecycleState::Active) {
+        context->viewController->warmUp();
+      }
       break;
     case MessageType::NextFrame: {
+      if (context->lifecycle != LifecycleState::Active) { break; }
+      context->viewController->updateLazyScene();
+      context->viewController->updateHiddenLines();
+      context->viewController->updateFeatureEdges();
+      context->viewController->updateAmbientOcclusion();
 
       if (context->isMessageQueueEmpty()) {
         schedNextFrameWith(MessageType::NextFrame);
@@ -370,6 +1020,9 @@ void StaircaseViewer::handleMessages(void *arg) {
   }
 
   isHandlingMessages = false;
+  ++context->loopTicks;
+  context->loopTime += emscripten_get_now() - loopStart;
+  context->frameLoopScheduled = nextFrame;
   if (nextFrame) { emscripten_set_timeout(handleMessages, FPS60, context); }
 }
 
@@ -384,7 +1037,48 @@ EMSCRIPTEN_BINDINGS(staircase) {
       .function("getDemoStepFile", &StaircaseViewer::getDemoStepFile)
       .function("getOCCTVersion", &StaircaseViewer::getOCCTVersion)
       .function("fitAllObjects", &StaircaseViewer::fitAllObjects)
+      .function("fitSelection", &StaircaseViewer::fitSelection)
+      .function("boxSelect", &StaircaseViewer::boxSelect)
+      .function("nearestPart", &StaircaseViewer::nearestPart)
+      .function("partsInBox", &StaircaseViewer::partsInBox)
+      .function("getProductChildren", &StaircaseViewer::getProductChildren)
+      .function("getProductNodeCount", &StaircaseViewer::getProductNodeCount)
       .function("removeAllObjects", &StaircaseViewer::removeAllObjects)
+      .function("getStats", &StaircaseViewer::getStats)
+      .function("setStatsOverlay", &StaircaseViewer::setStatsOverlay)
+      .class_function("setTracing", &StaircaseViewer::setTracing)
+      .class_function("getTraceJSON", &StaircaseViewer::getTraceJSON)
+      .class_function("clearTrace", &StaircaseViewer::clearTrace)
+      .class_function("setLoadArena", &StaircaseViewer::setLoadArena)
+      .class_function("setTransferPartitions", &StaircaseViewer::setTransferPartitions)
+      .class_function("setLazyLoading", &StaircaseViewer::setLazyLoading)
+      .class_function("setMeshOptimizationThreshold", &StaircaseViewer::setMeshOptimizationThreshold)
+      .function("expandBranch", &StaircaseViewer::expandBranch)
+      .function("collapseBranch", &StaircaseViewer::collapseBranch)
+      .function("setLazyMemoryBudget", &StaircaseViewer::setLazyMemoryBudget)
+      .function("setBatching", &StaircaseViewer::setBatching)
+      .function("setPartVisible", &StaircaseViewer::setPartVisible)
+      .function("setPartsVisible", &StaircaseViewer::setPartsVisible)
+      .function("isolateParts", &StaircaseViewer::isolateParts)
+      .function("setPartsColor", &StaircaseViewer::setPartsColor)
+      .function("resetPartsColor", &StaircaseViewer::resetPartsColor)
+      .function("setPartsTransparency", &StaircaseViewer::setPartsTransparency)
+      .function("loadGeneratedScene", &StaircaseViewer::loadGeneratedScene)
+      .function("setInstancing", &StaircaseViewer::setInstancing)
+      .function("setQuantization", &StaircaseViewer::setQuantization)
+      .function("setAdaptiveQuality", &StaircaseViewer::setAdaptiveQuality)
+      .function("setIdleAntialiasing", &StaircaseViewer::setIdleAntialiasing)
+      .function("setSelectionPrebuild", &StaircaseViewer::setSelectionPrebuild)
+      .function("setGpuPicking", &StaircaseViewer::setGpuPicking)
+      .function("setHiddenLineMode", &StaircaseViewer::setHiddenLineMode)
+      .function("setFeatureEdges", &StaircaseViewer::setFeatureEdges)
+      .function("setAmbientOcclusion", &StaircaseViewer::setAmbientOcclusion)
+      .function("suspend", &StaircaseViewer::suspend)
+      .function("evict", &StaircaseViewer::evict)
+      .function("resume", &StaircaseViewer::resume)
+      .function("getLifecycleState", &StaircaseViewer::getLifecycleState)
+      .class_function("setPreferredWebGLVersion", &StaircaseViewer::setPreferredWebGLVersion)
+      .class_function("setShaderWarmUp", &StaircaseViewer::setShaderWarmUp)
       .function("loadStepFile", &StaircaseViewer::loadStepFile)
       .function("getContainerId", &StaircaseViewer::getContainerId)
       .class_function("deleteViewer", &StaircaseViewer::deleteViewer, emscripten::allow_raw_pointers());
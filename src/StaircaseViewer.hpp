@@ -17,6 +17,10 @@ class StaircaseViewer {
   static std::condition_variable cv;
 
   static bool mainLoopSet;
+  static std::atomic<unsigned int> transferPartitions;
+  static std::atomic<bool> lazyLoading;
+  static std::atomic<int> preferredWebGLVersion;
+  static std::atomic<bool> shaderWarmUp;
 
 public:
 
@@ -25,6 +29,7 @@ public:
   static void ensureBackgroundWorker();
   static void pushBackground(const Staircase::Message& msg);
   static Staircase::Message popBackground();
+  static size_t backgroundQueueSize();
 
   static void deleteViewer(StaircaseViewer* viewer);
   int createCanvas(std::string containerId, std::string canvasId);
@@ -38,20 +43,210 @@ public:
   std::string getContainerId();
 
   int loadStepFile(std::string const &stepFileContent);
+
+  /**
+   * Loads a generated scene of small parts instead of a STEP file.
+   *
+   * @param partCount Number of parts to generate.
+   */
+  int loadGeneratedScene(unsigned int partCount);
   static void handleMessages(void *arg);
+
+  /** Stops the frame loop, e.g. while the viewer is scrolled out of view. */
+  void suspend();
+  /**
+   * Suspends and also releases the presentations, and the meshes of a
+   * model no other viewer shows. The camera and document are kept.
+   */
+  void evict();
+  /** Restarts the frame loop and shows an evicted model again. */
+  void resume();
+  std::string getLifecycleState();
   static void loadDefaultShaders(ViewerContext &context);
   static void cleanupDefaultShaders(ViewerContext &context);
   static void* backgroundWorker(void *arg);
   void setStepFileContent(const std::string& content);
   std::string getStepFileContent();
   void fitAllObjects ();
+  void fitSelection();
+
+  /**
+   * Selects the visible parts whose boxes intersect the region under a
+   * rectangle, in CSS pixels relative to the canvas.
+   *
+   * @return A Uint32Array of the selected part indices.
+   */
+  emscripten::val boxSelect(double x0, double y0, double x1, double y1);
+  /**
+   * The visible part whose box is hit first under a canvas point in CSS
+   * pixels, or -1.
+   */
+  int nearestPart(double x, double y);
+  /** A Uint32Array of the visible parts whose boxes meet a world box. */
+  emscripten::val partsInBox(double xmin, double ymin, double zmin, double xmax,
+                             double ymax, double zmax);
+
+  /**
+   * A page of the children of a node of the product structure, whose node
+   * 0 is the document. The object has the number of children as total and
+   * per child in the page its node id (ids), number of children
+   * (childCounts), occurrences of its product (instanceCounts), part index
+   * or -1 (parts), six floats of its world box (boxes) and an index into
+   * names, which has every name of the page once.
+   *
+   * @param node The node to expand.
+   * @param offset The first child of the page.
+   * @param count The most children in the page.
+   */
+  emscripten::val getProductChildren(unsigned int node, unsigned int offset,
+                                     unsigned int count);
+  unsigned int getProductNodeCount();
   void removeAllObjects();
+  emscripten::val getStats();
+  void setStatsOverlay(bool enabled);
+  static void setTracing(bool enabled);
+  static std::string getTraceJSON();
+  static void clearTrace();
+  static void setLoadArena(bool enabled);
+
+  /**
+   * Sets how many root partitions later loads transfer concurrently.
+   *
+   * @param partitions 0 or 1 transfers all roots on the background worker.
+   */
+  static void setTransferPartitions(unsigned int partitions);
+
+  /**
+   * In lazy mode, later loads show placeholder boxes first and mesh and
+   * display each branch when it enters the view or is expanded.
+   */
+  static void setLazyLoading(bool enabled);
+
+  /**
+   * Parts with at least this many triangles have their meshes reordered for
+   * the vertex cache when they are meshed; 0 turns it off (default 4096).
+   */
+  static void setMeshOptimizationThreshold(unsigned int triangles);
+  void expandBranch(unsigned int branch);
+  void collapseBranch(unsigned int branch);
+  void setLazyMemoryBudget(double bytes);
+
+  /** Whether later loads merge small parts into shared buffers per color. */
+  void setBatching(bool enabled);
+  void setPartVisible(unsigned int part, bool visible);
+
+  /**
+   * Bulk part changes that redraw once. Parts are given as a Uint32Array
+   * (or an array) of part indices.
+   */
+  void setPartsVisible(emscripten::val const &parts, bool visible);
+  /** Shows the given parts and hides all others. */
+  void isolateParts(emscripten::val const &parts);
+  /** Color components are sRGB, from 0 to 1. */
+  void setPartsColor(emscripten::val const &parts, double red, double green,
+                     double blue);
+  void resetPartsColor(emscripten::val const &parts);
+  /** From 0 for opaque to 1; batched parts stay opaque. */
+  void setPartsTransparency(emscripten::val const &parts, double transparency);
+
+  /** WebGL version that viewers created later try first (default 2). */
+  static void setPreferredWebGLVersion(int majorVersion);
+
+  /**
+   * Whether viewers created later compile the shaders and glyphs of the
+   * default scene right after construction (default), instead of on the
+   * first frame of a model; see stats.warmUp and stats.load.firstFrame.
+   */
+  static void setShaderWarmUp(bool enabled);
+
+  /**
+   * Whether later loads display repeated parts as located instances of one
+   * shared presentation.
+   */
+  void setInstancing(bool enabled);
+
+  /**
+   * Whether later loads upload parts with quantized positions and normals.
+   * Quantized parts are lit by a single head light without highlights, so
+   * they look flatter than the Phong shaded parts around them.
+   *
+   * @param enabled Whether to quantize.
+   * @param positionTolerance Largest position error as a fraction of the
+   *                          model's diagonal; parts above it keep full
+   *                          precision. 16 bits per axis give about 1.3e-5
+   *                          of a part's largest extent.
+   * @param normalTolerance Largest normal error in degrees.
+   */
+  void setQuantization(bool enabled, double positionTolerance,
+                       double normalTolerance);
+
+  /**
+   * Lowers the render resolution while the camera moves and frames take
+   * longer than targetFrameTime ms (default 33), and restores it when idle.
+   * Per vertex shading while moving is off by default.
+   *
+   * @param targetFrameTime Target in milliseconds, 0 for fixed quality.
+   * @param cheapShading Whether to shade per vertex while moving.
+   * @param hideSmallParts Whether to hide small parts while moving.
+   */
+  void setAdaptiveQuality(double targetFrameTime, bool cheapShading,
+                          bool hideSmallParts);
+
+  /**
+   * Redraws one antialiased frame once the camera is idle.
+   *
+   * @param samples MSAA samples (default 4), 0 to turn it off.
+   */
+  void setIdleAntialiasing(int samples);
+
+  /**
+   * Whether later loads create the parts' objects and their selection on
+   * the background worker (default on), so that the first pick does not
+   * build them.
+   */
+  void setSelectionPrebuild(bool enabled);
+
+  /**
+   * Whether later loads pick parts from an id rendering on the GPU, which
+   * costs one pixel readback per pick but a second copy of the geometry.
+   */
+  void setGpuPicking(bool enabled);
+
+  /**
+   * Draws the visible edges of the parts instead of shading them, computed
+   * with HLR once the camera is still; see stats.hlr for the compute times.
+   *
+   * @param enabled Whether to draw hidden lines.
+   * @param showHidden Whether to also draw hidden edges, dashed.
+   */
+  void setHiddenLineMode(bool enabled, bool showHidden);
+
+  /**
+   * Draws the boundaries and the creases sharper than an angle over the
+   * parts, extracted from their triangulations; see stats.edges.
+   *
+   * @param enabled Whether to draw feature edges.
+   * @param angle The smallest crease angle, in degrees (default 30).
+   */
+  void setFeatureEdges(bool enabled, double angle);
+
+  /**
+   * Shades batched parts with ambient occlusion baked on the worker pool,
+   * filled in as parts finish; see stats.ao.
+   *
+   * @param enabled Whether to shade with ambient occlusion.
+   * @param rays Rays per vertex (default 16).
+   */
+  void setAmbientOcclusion(bool enabled, int rays);
 
 private:
   std::string _stepFileContent;
+  std::atomic<unsigned int> generatedPartCount = 0;
   std::mutex stepFileContentMutex;
 
   static void* _loadStepFile(void *args);
+  static void* _loadGeneratedScene(void *args);
+  static void* _remeshModel(void *args);
 };
 
 extern "C" void dummyMainLoop();
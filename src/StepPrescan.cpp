@@ -0,0 +1,122 @@
+#include "StepPrescan.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+size_t const MinChunkSize = 1 << 20;
+
+// Bit i of the result is set if p[i] == c, for 16 bytes.
+#ifdef __wasm_simd128__
+uint32_t matchMask(char const *p, char c) {
+  v128_t bytes = wasm_v128_load(p);
+  return wasm_i8x16_bitmask(wasm_i8x16_eq(bytes, wasm_i8x16_splat(c)));
+}
+#endif
+
+size_t countQuotes(char const *begin, char const *end) {
+  size_t count = 0;
+  char const *p = begin;
+#ifdef __wasm_simd128__
+  for (; p + 16 <= end; p += 16) {
+    count += __builtin_popcount(matchMask(p, '\''));
+  }
+#endif
+  for (; p < end; ++p) {
+    count += (*p == '\'');
+  }
+  return count;
+}
+
+// STEP escapes a quote inside a string by doubling it, which toggles the
+// state twice, so quote parity alone tells whether we are inside a string.
+size_t countRecords(char const *begin, char const *end, bool inString) {
+  size_t count = 0;
+  char const *p = begin;
+#ifdef __wasm_simd128__
+  for (; p + 16 <= end; p += 16) {
+    uint32_t quotes = matchMask(p, '\'');
+    uint32_t semicolons = matchMask(p, ';');
+    if (!quotes) {
+      if (!inString) { count += __builtin_popcount(semicolons); }
+      continue;
+    }
+    for (uint32_t bits = quotes | semicolons; bits; bits &= bits - 1) {
+      uint32_t const bit = bits & -bits;
+      if (quotes & bit) {
+        inString = !inString;
+      } else if (!inString) {
+        ++count;
+      }
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == '\'') {
+      inString = !inString;
+    } else if (*p == ';' && !inString) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+StepPrescan prescanStepData(std::string const &content) {
+  TRACE_SCOPE("prescanStepData");
+  StepPrescan result;
+
+  // The header section ends before DATA starts; the last ENDSEC closes it.
+  size_t const headerEnd = content.find("ENDSEC;");
+  size_t const dataKeyword =
+      headerEnd == std::string::npos ? headerEnd
+                                     : content.find("DATA;", headerEnd);
+  size_t const dataEnd = content.rfind("ENDSEC;");
+  if (dataKeyword == std::string::npos || dataEnd == std::string::npos ||
+      dataEnd <= dataKeyword) {
+    return result;
+  }
+
+  result.hasDataSection = true;
+  result.dataBegin = dataKeyword + 5;
+  result.dataEnd = dataEnd;
+
+  size_t const length = result.dataEnd - result.dataBegin;
+  size_t const chunkCount = std::max<size_t>(
+      1, std::min(WorkerPool::size() + 1, length / MinChunkSize));
+  size_t const chunkSize = (length + chunkCount - 1) / chunkCount;
+  char const *data = content.data() + result.dataBegin;
+
+  auto chunkBegin = [&](size_t i) { return data + std::min(length, i * chunkSize); };
+  auto chunkEnd = [&](size_t i) { return data + std::min(length, (i + 1) * chunkSize); };
+
+  std::vector<size_t> quotes(chunkCount);
+  WorkerPool::parallelFor(chunkCount, [&](size_t i) {
+    quotes[i] = countQuotes(chunkBegin(i), chunkEnd(i));
+  });
+
+  std::vector<size_t> records(chunkCount);
+  std::vector<bool> startsInString(chunkCount);
+  size_t quotesBefore = 0;
+  for (size_t i = 0; i < chunkCount; ++i) {
+    startsInString[i] = quotesBefore % 2 == 1;
+    quotesBefore += quotes[i];
+  }
+
+  WorkerPool::parallelFor(chunkCount, [&](size_t i) {
+    records[i] = countRecords(chunkBegin(i), chunkEnd(i), startsInString[i]);
+  });
+
+  for (size_t count : records) {
+    result.entityCount += count;
+  }
+  return result;
+}
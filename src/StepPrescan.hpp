@@ -0,0 +1,26 @@
+#ifndef STEPPRESCAN_HPP
+#define STEPPRESCAN_HPP
+#include <cstddef>
+#include <string>
+
+struct StepPrescan {
+  bool hasDataSection = false;
+  size_t dataBegin = 0;
+  size_t dataEnd = 0;
+  size_t entityCount = 0;
+};
+
+/**
+ * Counts the `#id = ENTITY(...);` records of the DATA section without
+ * parsing them, by finding the semicolons that are not inside string
+ * literals. The section is split across the worker pool: a first pass counts
+ * quotes per chunk so that each chunk knows whether it starts inside a
+ * string, a second pass counts record terminators. Both passes use wasm SIMD
+ * when built with -msimd128. Comments are not recognized, so the count is
+ * approximate for files that contain semicolons in comments.
+ *
+ * @param content The raw STEP file content.
+ */
+StepPrescan prescanStepData(std::string const &content);
+
+#endif // STEPPRESCAN_HPP
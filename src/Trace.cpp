@@ -0,0 +1,158 @@
+#include "Trace.hpp"
+#include <array>
+#include <emscripten.h>
+#include <emscripten/threading.h>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace Trace {
+
+std::atomic<bool> enabled{false};
+
+namespace {
+
+struct Event {
+  char const *name;
+  double start;
+  double duration;
+  uint16_t depth;
+};
+
+// A ring slot. The sequence is odd while the owner writes the event and
+// 2 * (index + 1) once event number index is complete, so that readers can
+// tell a consistent copy from a torn one.
+struct Slot {
+  std::atomic<uint64_t> sequence{0};
+  Event event;
+};
+
+// Single-producer ring: only the owning thread writes, so recording needs no
+// lock. Readers drop events overwritten while they were copying them.
+struct ThreadBuffer {
+  static size_t const Capacity = 8192;
+
+  std::array<Slot, Capacity> slots;
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> clearedAt{0};
+  std::atomic<char const *> threadName{nullptr};
+  uint16_t depth = 0;
+  int tid = 0;
+  bool isMainThread = false;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+ThreadBuffer &localBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (!buffer) {
+    auto newBuffer = std::make_unique<ThreadBuffer>();
+    newBuffer->isMainThread = emscripten_is_main_runtime_thread();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    newBuffer->tid = static_cast<int>(buffers.size()) + 1;
+    buffer = newBuffer.get();
+    buffers.push_back(std::move(newBuffer));
+  }
+  return *buffer;
+}
+
+void appendEscaped(std::ostringstream &out, char const *text) {
+  for (char const *c = text; *c; ++c) {
+    if (*c == '"' || *c == '\\') { out << '\\'; }
+    out << *c;
+  }
+}
+
+} // namespace
+
+void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+void setThreadName(char const *name) {
+  localBuffer().threadName.store(name, std::memory_order_relaxed);
+}
+
+void Span::begin() {
+  ThreadBuffer &buffer = localBuffer();
+  depth = buffer.depth++;
+  start = emscripten_get_now();
+}
+
+void Span::end() {
+  double const now = emscripten_get_now();
+  ThreadBuffer &buffer = localBuffer();
+  --buffer.depth;
+
+  uint64_t const index = buffer.written.load(std::memory_order_relaxed);
+  Slot &slot = buffer.slots[index % ThreadBuffer::Capacity];
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = {name, start, now - start, depth};
+  slot.sequence.store(2 * (index + 1), std::memory_order_release);
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (auto const &buffer : buffers) {
+    buffer->clearedAt.store(buffer->written.load(std::memory_order_acquire),
+                            std::memory_order_relaxed);
+  }
+}
+
+std::string toChromeJSON() {
+  std::ostringstream out;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&first, &out]() {
+    if (!first) { out << ","; }
+    first = false;
+  };
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (auto const &buffer : buffers) {
+    char const *threadName = buffer->threadName.load(std::memory_order_relaxed);
+    separator();
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << buffer->tid << ",\"args\":{\"name\":\"";
+    if (threadName) {
+      appendEscaped(out, threadName);
+    } else if (buffer->isMainThread) {
+      out << "main";
+    } else {
+      out << "worker " << buffer->tid;
+    }
+    out << "\"}}";
+
+    uint64_t const written = buffer->written.load(std::memory_order_acquire);
+    uint64_t begin = buffer->clearedAt.load(std::memory_order_relaxed);
+    if (written - begin >= ThreadBuffer::Capacity) {
+      begin = written - ThreadBuffer::Capacity + 1;
+    }
+
+    for (uint64_t i = begin; i < written; ++i) {
+      Slot const &slot = buffer->slots[i % ThreadBuffer::Capacity];
+      uint64_t const expected = 2 * (i + 1);
+      if (slot.sequence.load(std::memory_order_acquire) != expected) { continue; }
+      Event const event = slot.event;
+      // Skip the slot if the owner wrapped around onto it while copying; the
+      // copy, its name pointer included, may then be torn.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != expected) { continue; }
+
+      separator();
+      out << "{\"name\":\"";
+      appendEscaped(out, event.name);
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"ts\":" << static_cast<int64_t>(event.start * 1000.0)
+          << ",\"dur\":" << static_cast<int64_t>(event.duration * 1000.0)
+          << ",\"args\":{\"depth\":" << event.depth << "}}";
+    }
+  }
+  out << "]}";
+  return out.str();
+}
+
+} // namespace Trace
@@ -0,0 +1,62 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Trace {
+
+extern std::atomic<bool> enabled;
+
+inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+void setEnabled(bool value);
+
+/**
+ * Names the calling thread in the exported trace. Threads that never call
+ * this show up as "main" or "worker <id>".
+ *
+ * @param name A string literal; it is stored, not copied.
+ */
+void setThreadName(char const *name);
+
+/**
+ * Serializes the spans currently held in every thread's ring buffer as
+ * Chrome trace-event JSON, loadable in Perfetto or chrome://tracing.
+ */
+std::string toChromeJSON();
+void clear();
+
+/**
+ * Scoped trace span. When tracing is disabled, construction costs a relaxed
+ * atomic load and the destructor a null check.
+ *
+ * @param name A string literal; it is stored, not copied.
+ */
+class Span {
+public:
+  explicit Span(char const *name) : name(isEnabled() ? name : nullptr) {
+    if (this->name) { begin(); }
+  }
+  ~Span() {
+    if (name) { end(); }
+  }
+
+  Span(Span const &) = delete;
+  Span &operator=(Span const &) = delete;
+
+private:
+  char const *name;
+  double start = 0.0;
+  uint16_t depth = 0;
+
+  void begin();
+  void end();
+};
+
+} // namespace Trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_HPP
@@ -1,5 +1,7 @@
 #ifndef VIEWERCONTEXT_HPP
 #define VIEWERCONTEXT_HPP
+#include "ModelRegistry.hpp"
+#include "ViewerStats.hpp"
 #include "staircase.hpp"
 #include <AIS_InteractiveContext.hxx>
 #include <GLES2/gl2.h>
@@ -10,10 +12,14 @@
 #include <opencascade/XCAFApp_Application.hxx>
 #include <queue>
 
+// Active viewers run their frame loop. Suspended ones keep everything but
+// the loop; evicted ones also drop their presentations, and the meshes
+// of a model no other viewer shows.
+enum class LifecycleState { Active, Suspended, Evicted };
+
 class ViewerContext {
 public:
 
-
   void pushMessage(Staircase::Message const &msg) {
     std::lock_guard<std::mutex> lock(queueMutex);
     messageQueue.push(msg);
@@ -31,6 +37,11 @@ public:
     return messageQueue.empty();
   }
 
+  size_t messageQueueSize() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return messageQueue.size();
+  }
+
   void pushBackground(const Staircase::Message& msg) {
     std::unique_lock<std::mutex> lock(backgroundQueueMutex);
     backgroundQueue.push(msg);
@@ -45,7 +56,51 @@ public:
     return msg;
   }
 
-  Handle(TDocStd_Document) currentlyViewingDoc;
+  // Set by the background worker once a model is ready; taken over into
+  // currentModel on the main thread when InitStepFile is handled. The
+  // objects are the ones the controller prebuilt for it, if any.
+  void setPendingModel(ModelUse model,
+                       std::vector<Handle(AIS_InteractiveObject)> objects = {}) {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    pendingModel = std::move(model);
+    pendingObjects = std::move(objects);
+  }
+
+  ModelUse takePendingModel() {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    return std::move(pendingModel);
+  }
+
+  std::vector<Handle(AIS_InteractiveObject)> takePendingObjects() {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    return std::move(pendingObjects);
+  }
+
+  // Set on the main thread when an evicted viewer resumes; the background
+  // worker meshes the model again and hands it back as the pending model.
+  void requestRemesh(std::shared_ptr<LoadedModel> const &model) {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    remeshModel = model;
+  }
+
+  std::shared_ptr<LoadedModel> takeRemeshRequest() {
+    std::lock_guard<std::mutex> lock(modelMutex);
+    return std::move(remeshModel);
+  }
+
+  std::shared_ptr<LoadedModel> currentModel;
+  // The use of the model on screen; released when the viewer is evicted.
+  ModelUse shownModel;
+  ViewerStats stats;
+
+  LifecycleState lifecycle = LifecycleState::Active;
+  bool frameLoopScheduled = false;
+  // The camera of an evicted viewer, restored with its model on resume.
+  Handle(Graphic3d_Camera) evictedCamera;
+  unsigned long loopTicks = 0;
+  double loopTime = 0.0;
+  // Milliseconds of product structure pages, converted to JS included.
+  FrameTimeHistory productQueryTimes;
 
   bool showingSpinner = false;
   GLuint shaderProgram;
@@ -96,6 +151,7 @@ public:
   }
 
   EMSCRIPTEN_WEBGL_CONTEXT_HANDLE webGLContext;
+  bool parallelShaderCompile = false;
 private:
   Handle(V3d_View) view;
   std::queue<Staircase::Message> messageQueue;
@@ -104,6 +160,11 @@ private:
   std::queue<Staircase::Message> backgroundQueue;
   std::mutex backgroundQueueMutex;
   std::condition_variable cv;
+
+  ModelUse pendingModel;
+  std::vector<Handle(AIS_InteractiveObject)> pendingObjects;
+  std::shared_ptr<LoadedModel> remeshModel;
+  std::mutex modelMutex;
 };
 
 #endif // VIEWERCONTEXT_HPP
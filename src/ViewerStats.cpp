@@ -0,0 +1,149 @@
+#include "ViewerStats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <emscripten.h>
+
+void FrameTimeHistory::push(double milliseconds) {
+  samples[next] = milliseconds;
+  next = (next + 1) % Capacity;
+  count = std::min(count + 1, Capacity);
+}
+
+double FrameTimeHistory::percentile(double p) const {
+  if (count == 0) { return 0.0; }
+
+  std::vector<double> sorted(samples.begin(), samples.begin() + count);
+  size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * count));
+  rank = std::clamp<size_t>(rank, 1, count) - 1;
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  return sorted[rank];
+}
+
+double FrameTimeHistory::max() const {
+  if (count == 0) { return 0.0; }
+  return *std::max_element(samples.begin(), samples.begin() + count);
+}
+
+void ViewerStats::beginLoad(bool sharedModel) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  phases.fill(0.0);
+  memory.fill(PhaseMemory());
+  this->sharedModel = sharedModel;
+  loading = true;
+  entities = 0;
+  transferFraction = 0.0;
+  partitions = 0;
+  pinnedChunks = 0;
+  loadStart = emscripten_get_now();
+  interactiveAfter = 0.0;
+}
+
+void ViewerStats::endLoad() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  if (loading) {
+    loading = false;
+    ++loadsCompleted;
+  }
+}
+
+void ViewerStats::recordPhase(LoadPhase::Type phase, double milliseconds,
+                              HeapSnapshot const &before,
+                              HeapSnapshot const &after) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  phases[phase] += milliseconds;
+
+  PhaseMemory &phaseMemory = memory[phase];
+  phaseMemory.peakFootprint = after.peakFootprint;
+  phaseMemory.heapSize = after.heapSize;
+  phaseMemory.inUseDelta += static_cast<int64_t>(after.inUse) -
+                            static_cast<int64_t>(before.inUse);
+  phaseMemory.allocations += after.allocations - before.allocations;
+  phaseMemory.allocatedBytes += after.allocatedBytes - before.allocatedBytes;
+}
+
+std::array<double, LoadPhase::Count> ViewerStats::phaseTimings() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return phases;
+}
+
+std::array<PhaseMemory, LoadPhase::Count> ViewerStats::phaseMemory() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return memory;
+}
+
+bool ViewerStats::isLoading() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return loading;
+}
+
+unsigned int ViewerStats::completedLoads() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return loadsCompleted;
+}
+
+void ViewerStats::setEntityCount(size_t count) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  entities = count;
+}
+
+size_t ViewerStats::entityCount() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return entities;
+}
+
+void ViewerStats::setTransferProgress(double fraction) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  transferFraction = fraction;
+}
+
+double ViewerStats::transferProgress() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return transferFraction;
+}
+
+void ViewerStats::setTransferPartitions(size_t count) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  partitions = count;
+}
+
+size_t ViewerStats::transferPartitions() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return partitions;
+}
+
+void ViewerStats::setArenaChunksPinned(uint64_t count) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  pinnedChunks = count;
+}
+
+uint64_t ViewerStats::arenaChunksPinned() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return pinnedChunks;
+}
+
+void ViewerStats::markInteractive() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  interactiveAfter = emscripten_get_now() - loadStart;
+}
+
+double ViewerStats::timeToInteractive() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return interactiveAfter;
+}
+
+bool ViewerStats::loadedSharedModel() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return sharedModel;
+}
+
+PhaseTimer::PhaseTimer(ViewerStats *stats, LoadPhase::Type phase)
+    : span(LoadPhase::toString(phase)), stats(stats), phase(phase),
+      start(emscripten_get_now()),
+      heapBefore(stats ? MemoryProfiler::snapshot() : HeapSnapshot()) {}
+
+PhaseTimer::~PhaseTimer() {
+  if (stats) {
+    stats->recordPhase(phase, emscripten_get_now() - start, heapBefore,
+                       MemoryProfiler::snapshot());
+  }
+}
@@ -0,0 +1,117 @@
+#ifndef VIEWERSTATS_HPP
+#define VIEWERSTATS_HPP
+#include "MemoryProfiler.hpp"
+#include "Trace.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace LoadPhase {
+enum Type { Read, Transfer, Traversal, Mesh, Index, Display, Count };
+
+static char const *toString(Type type) {
+  switch (type) {
+  case Read: return "read";
+  case Transfer: return "transfer";
+  case Traversal: return "traversal";
+  case Mesh: return "mesh";
+  case Index: return "index";
+  case Display: return "display";
+  default: return "unknown";
+  }
+}
+} // namespace LoadPhase
+
+/**
+ * Fixed-size ring of frame times. Pushing is O(1) so it can stay enabled in
+ * production; percentiles are only computed when stats are requested.
+ */
+class FrameTimeHistory {
+public:
+  static size_t const Capacity = 240;
+
+  void push(double milliseconds);
+  size_t size() const { return count; }
+  double percentile(double p) const;
+  double max() const;
+
+private:
+  std::array<double, Capacity> samples{};
+  size_t next = 0;
+  size_t count = 0;
+};
+
+struct PhaseMemory {
+  size_t peakFootprint = 0; // malloc high-water mark at the end of the phase
+  size_t heapSize = 0;      // wasm heap size at the end of the phase
+  int64_t inUseDelta = 0;   // bytes still allocated that the phase added
+  uint64_t allocations = 0;
+  uint64_t allocatedBytes = 0;
+};
+
+/**
+ * Load pipeline timings and heap usage of a viewer. Written by the
+ * background worker and the main thread, read from JS.
+ */
+class ViewerStats {
+public:
+  void beginLoad(bool sharedModel);
+  void endLoad();
+  void recordPhase(LoadPhase::Type phase, double milliseconds,
+                   HeapSnapshot const &before, HeapSnapshot const &after);
+  std::array<double, LoadPhase::Count> phaseTimings();
+  std::array<PhaseMemory, LoadPhase::Count> phaseMemory();
+  bool loadedSharedModel();
+  bool isLoading();
+  unsigned int completedLoads();
+
+  void setEntityCount(size_t count);
+  size_t entityCount();
+  void setTransferProgress(double fraction);
+  double transferProgress();
+  void setTransferPartitions(size_t count);
+  size_t transferPartitions();
+  // Arena chunks of the load still held after its reader was freed, each
+  // pinning a whole chunk of heap for a few blocks.
+  void setArenaChunksPinned(uint64_t count);
+  uint64_t arenaChunksPinned();
+
+  // Milliseconds from beginLoad() until the model could first be navigated.
+  void markInteractive();
+  double timeToInteractive();
+
+private:
+  std::mutex statsMutex;
+  std::array<double, LoadPhase::Count> phases{};
+  std::array<PhaseMemory, LoadPhase::Count> memory{};
+  bool sharedModel = false;
+  bool loading = false;
+  unsigned int loadsCompleted = 0;
+  size_t entities = 0;
+  double transferFraction = 0.0;
+  size_t partitions = 0;
+  uint64_t pinnedChunks = 0;
+  double loadStart = 0.0;
+  double interactiveAfter = 0.0;
+};
+
+/**
+ * Records the time and heap usage of a load phase when it goes out of scope,
+ * and traces it as a span named after the phase.
+ */
+class PhaseTimer {
+public:
+  PhaseTimer(ViewerStats *stats, LoadPhase::Type phase);
+  ~PhaseTimer();
+
+private:
+  Trace::Span span;
+  ViewerStats *stats;
+  LoadPhase::Type phase;
+  double start;
+  HeapSnapshot heapBefore;
+};
+
+#endif // VIEWERSTATS_HPP
@@ -0,0 +1,102 @@
+#include "WorkerPool.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+std::mutex WorkerPool::startMutex;
+std::vector<pthread_t> WorkerPool::threads;
+std::queue<std::function<void()>> WorkerPool::jobs;
+std::mutex WorkerPool::jobsMutex;
+std::condition_variable WorkerPool::cv;
+
+void WorkerPool::ensureStarted() {
+  std::lock_guard<std::mutex> guard(startMutex);
+  if (!threads.empty()) { return; }
+
+  // Leave one core to the main thread and one to the background worker.
+  unsigned int const cores = std::thread::hardware_concurrency();
+  size_t const count = std::clamp<size_t>(cores > 2 ? cores - 2 : 1, 1, 8);
+
+  threads.resize(count);
+  for (auto &thread : threads) {
+    pthread_create(&thread, NULL, WorkerPool::workerLoop, NULL);
+  }
+}
+
+size_t WorkerPool::size() {
+  ensureStarted();
+  std::lock_guard<std::mutex> guard(startMutex);
+  return threads.size();
+}
+
+void WorkerPool::submit(std::function<void()> const &job) {
+  ensureStarted();
+  std::unique_lock<std::mutex> lock(jobsMutex);
+  jobs.push(job);
+  cv.notify_one();
+}
+
+void WorkerPool::parallelFor(size_t count,
+                             std::function<void(size_t)> const &body) {
+  if (count == 0) { return; }
+
+  struct Batch {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+  };
+  auto batch = std::make_shared<Batch>();
+
+  auto drain = [batch, count, &body]() {
+    size_t index;
+    while ((index = batch->next.fetch_add(1)) < count) {
+      try {
+        body(index);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        if (!batch->error) { batch->error = std::current_exception(); }
+      }
+      // Failed indices count as done too, or the caller would wait forever.
+      if (batch->done.fetch_add(1) + 1 == count) {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->finished.notify_all();
+      }
+    }
+  };
+
+  size_t const helpers = std::min(count, size() + 1) - 1;
+  for (size_t i = 0; i < helpers; ++i) {
+    submit(drain);
+  }
+  drain();
+
+  // Helpers that start after all indices were claimed return immediately,
+  // so `body` is not referenced once this returns.
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->finished.wait(lock, [&batch, count] { return batch->done == count; });
+  if (batch->error) { std::rethrow_exception(batch->error); }
+}
+
+void *WorkerPool::workerLoop(void *) {
+  Trace::setThreadName("pool worker");
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(jobsMutex);
+      cv.wait(lock, [] { return !jobs.empty(); });
+      job = std::move(jobs.front());
+      jobs.pop();
+    }
+    try {
+      job();
+    } catch (...) {
+      std::cerr << "Worker pool job failed." << std::endl;
+    }
+  }
+  return nullptr;
+}
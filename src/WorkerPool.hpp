@@ -0,0 +1,45 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <pthread.h>
+#include <queue>
+#include <vector>
+
+/**
+ * Module-wide pool of worker threads shared by every viewer.
+ *
+ * Threads are started lazily on first use. parallelFor() blocks the caller
+ * and must not be called from the main browser thread; the background
+ * worker uses it to spread load-time work over the pool.
+ */
+class WorkerPool {
+public:
+  static void ensureStarted();
+  static size_t size();
+
+  static void submit(std::function<void()> const &job);
+
+  /**
+   * Runs body(i) for every i in [0, count) on the pool and the calling
+   * thread, and returns when all of them have finished. If any body throws,
+   * the remaining indices still run and the first exception is rethrown on
+   * the calling thread.
+   */
+  static void parallelFor(size_t count,
+                          std::function<void(size_t)> const &body);
+
+private:
+  static std::mutex startMutex;
+  static std::vector<pthread_t> threads;
+
+  static std::queue<std::function<void()>> jobs;
+  static std::mutex jobsMutex;
+  static std::condition_variable cv;
+
+  static void *workerLoop(void *arg);
+};
+
+#endif // WORKERPOOL_HPP
@@ -1,6 +1,7 @@
 #ifndef STAIRCASE_HPP
 #define STAIRCASE_HPP
 #include "StaircaseViewController.hpp"
+#include "Trace.hpp"
 #include <any>
 #include <iostream>
 
@@ -21,6 +22,9 @@ enum Type {
   InitStepFile,
   NextFrame,
   LoadStepFile,
+  LoadGeneratedScene,
+  RemeshModel,
+  WarmUp,
 };
 
 static char const *toString(Type type) {
@@ -33,6 +37,9 @@ static char const *toString(Type type) {
   case InitEmptyScene: return "InitEmptyScene";
   case NextFrame: return "NextFrame";
   case LoadStepFile: return "LoadStepFile";
+  case LoadGeneratedScene: return "LoadGeneratedScene";
+  case RemeshModel: return "RemeshModel";
+  case WarmUp: return "WarmUp";
   default: return "Unknown";
   }
 }
@@ -55,24 +62,6 @@ int const AIS_SHADED_MODE = 1;
 struct RGB {
   float r, g, b;
 };
-class Timer {
-public:
-  Timer(std::string const &timerName)
-      : name(timerName), start(std::chrono::high_resolution_clock::now()) {}
-
-  ~Timer() {
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration =
-        std::chrono::duration_cast<std::chrono::microseconds>(end - start)
-            .count();
-    double seconds = static_cast<double>(duration) / 1e6;
-    std::cout << "[TIMER] " << seconds << "s:" << name << std::endl;
-  }
-
-private:
-  std::string name;
-  std::chrono::time_point<std::chrono::high_resolution_clock> start;
-};
 namespace Colors {
 // clang-format off
 const RGB Red      = {1.0f, 0.0f, 0.0f};
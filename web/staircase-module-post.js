@@ -21,11 +21,62 @@ if (typeof document !== "undefined") { // To avoid this code block in worker thr
         window.Staircase._viewers = window.Staircase._viewers || new Map();
         window.Staircase._observers = window.Staircase._observers || new Map();
         window.Staircase._containerIds = window.Staircase._containerIds || new Set();
+        window.Staircase._visibility = window.Staircase._visibility || new Map();
+
+        // Viewers out of view stop their frame loop, and release their
+        // presentations once they stayed out of view for evictAfter ms
+        // (default 30 s, negative to never evict). The margin resumes them
+        // a little before they scroll back in. Set lifecycle to false to
+        // keep every viewer active.
+        let observeVisibility = function(containerId, viewer) {
+            let divElement = document.getElementById(containerId);
+            if (!divElement || typeof IntersectionObserver === "undefined" ||
+                window.Staircase.lifecycle === false) {
+                return;
+            }
+            let evictTimer = null;
+            let cancelEviction = function() {
+                clearTimeout(evictTimer);
+                evictTimer = null;
+            };
+            let observer = new IntersectionObserver(entries => {
+                let entry = entries[entries.length - 1];
+                if (entry.isIntersecting) {
+                    cancelEviction();
+                    viewer.resume();
+                    return;
+                }
+                viewer.suspend();
+                let evictAfter = window.Staircase.evictAfter ?? 30000;
+                if (evictAfter >= 0 && evictTimer === null) {
+                    evictTimer = setTimeout(() => {
+                        evictTimer = null;
+                        viewer.evict();
+                    }, evictAfter);
+                }
+            }, { rootMargin: "200px" });
+            observer.observe(divElement);
+            window.Staircase._visibility.set(containerId, {
+                disconnect: () => {
+                    cancelEviction();
+                    observer.disconnect();
+                }
+            });
+        };
 
         let ensureViewerCreated = function(containerId) {
             if (!window.Staircase._viewers.has(containerId)) {
+                if (window.Staircase.webGLVersion) {
+                    module.StaircaseViewer.setPreferredWebGLVersion(
+                        window.Staircase.webGLVersion);
+                }
+                if (window.Staircase.shaderWarmUp !== undefined) {
+                    module.StaircaseViewer.setShaderWarmUp(
+                        window.Staircase.shaderWarmUp);
+                }
                 let viewer = new module.StaircaseViewer(containerId);
                 window.Staircase._viewers.set(containerId, viewer);
+                observeVisibility(containerId, viewer);
                 return viewer;
             }
             return window.Staircase._viewers.get(containerId);
@@ -100,6 +151,8 @@ if (typeof document !== "undefined") { // To avoid this code block in worker thr
         flushQueue();
 
         window.Staircase.cleanUp = function() {
+            window.Staircase._visibility.forEach(x => x.disconnect());
+            window.Staircase._visibility.clear();
 
             for (let [containerId, viewer] of Staircase._viewers) {
                 if (viewer) {